@@ -0,0 +1,131 @@
+#ifndef GLCM_COOCCURRENCE_MATRIX_HPP_
+#define GLCM_COOCCURRENCE_MATRIX_HPP_
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace glcm {
+
+const int num_directions = 4; // H (0 deg), V (90 deg), LD (135 deg) and RD (45 deg), in the order of the Direction enum
+
+// Allocator giving the storage of a std::vector a 64 bytes (cache line and AVX-512) alignment
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+    static const std::size_t alignment = 64;
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        std::size_t bytes = (n * sizeof(T) + alignment - 1) / alignment * alignment;
+        void* ptr = std::aligned_alloc(alignment, bytes);
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, std::size_t) {
+        std::free(ptr);
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const {
+        return false;
+    }
+};
+
+// Ng x Ng matrices of the four directions in one contiguous buffer, interleaved per cell as [i][j][direction], so the values of
+// all the directions of a cell are loaded together and a row i is a single run of Ng * num_directions elements
+template <typename T>
+class CooccurrenceMatrix {
+public:
+    CooccurrenceMatrix() = default;
+    ~CooccurrenceMatrix() = default;
+
+    void Resize(int Ng) {
+        _Ng = Ng;
+        _data.assign((std::size_t)Ng * Ng * num_directions, T(0));
+    }
+
+    void Fill(T value) {
+        std::fill(_data.begin(), _data.end(), value);
+    }
+
+    void FillBlock(int begin, int end, T value) { // cells [begin, end) x [begin, end)
+        for (int i = begin; i < end; ++i) {
+            T* row = Cell(i, begin); // Cell(Ng - 1, Ng) would index past the data
+            std::fill(row, row + (std::size_t)(end - begin) * num_directions, value);
+        }
+    }
+
+    int Ng() const {
+        return _Ng;
+    }
+
+    T* Data() {
+        return _data.data();
+    }
+    const T* Data() const {
+        return _data.data();
+    }
+
+    std::size_t Size() const {
+        return _data.size();
+    }
+
+    T* Row(int i) {
+        return &_data[(std::size_t)i * _Ng * num_directions];
+    }
+    const T* Row(int i) const {
+        return &_data[(std::size_t)i * _Ng * num_directions];
+    }
+
+    T* Cell(int i, int j) {
+        return &_data[((std::size_t)i * _Ng + j) * num_directions];
+    }
+    const T* Cell(int i, int j) const {
+        return &_data[((std::size_t)i * _Ng + j) * num_directions];
+    }
+
+    T& operator()(int i, int j, int direction) {
+        return _data[((std::size_t)i * _Ng + j) * num_directions + direction];
+    }
+    const T& operator()(int i, int j, int direction) const {
+        return _data[((std::size_t)i * _Ng + j) * num_directions + direction];
+    }
+
+private:
+    int _Ng = 0;
+    std::vector<T, AlignedAllocator<T>> _data;
+};
+
+// Non-zero cells of the four direction matrices in row-major order, with the counts interleaved per cell as [cell][direction], for
+// regions having far fewer pixel pairs than matrix cells
+struct SparseCooccurrenceMatrix {
+    void Clear() {
+        rows.clear();
+        cols.clear();
+        counts.clear();
+    }
+
+    int Size() const {
+        return (int)rows.size();
+    }
+
+    std::vector<int> rows;
+    std::vector<int> cols;
+    std::vector<int, AlignedAllocator<int>> counts;
+};
+
+} // namespace glcm
+
+#endif // GLCM_COOCCURRENCE_MATRIX_HPP_
@@ -0,0 +1,90 @@
+#include "FeatureKernels.hpp"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "FeatureKernelsImpl.hpp"
+
+namespace glcm {
+
+namespace {
+
+// Four plain doubles, the portable counterpart of the AVX2 register
+struct ScalarVec {
+    double v[4];
+
+    static ScalarVec Zero() {
+        return {{0.0, 0.0, 0.0, 0.0}};
+    }
+    static ScalarVec Broadcast(double x) {
+        return {{x, x, x, x}};
+    }
+    static ScalarVec Load(const double* p) {
+        return {{p[0], p[1], p[2], p[3]}};
+    }
+    static ScalarVec LoadInt(const int* p) {
+        return {{(double)p[0], (double)p[1], (double)p[2], (double)p[3]}};
+    }
+    static ScalarVec Max(const ScalarVec& a, const ScalarVec& b) { // same as _mm256_max_pd: b when a > b is false or unordered
+        return {{a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1], a.v[2] > b.v[2] ? a.v[2] : b.v[2],
+            a.v[3] > b.v[3] ? a.v[3] : b.v[3]}};
+    }
+    static ScalarVec XLogX(const ScalarVec& x) { // x log(x), 0 where x <= 0
+        return {{x.v[0] > 0 ? x.v[0] * log(x.v[0]) : 0.0, x.v[1] > 0 ? x.v[1] * log(x.v[1]) : 0.0,
+            x.v[2] > 0 ? x.v[2] * log(x.v[2]) : 0.0, x.v[3] > 0 ? x.v[3] * log(x.v[3]) : 0.0}};
+    }
+    static ScalarVec Gather(const double* table, const int* index) {
+        return {{table[index[0]], table[index[1]], table[index[2]], table[index[3]]}};
+    }
+    static ScalarVec Positive(const ScalarVec& x, const ScalarVec& value) { // value where x > 0, otherwise 0
+        return {{x.v[0] > 0 ? value.v[0] : 0.0, x.v[1] > 0 ? value.v[1] : 0.0, x.v[2] > 0 ? value.v[2] : 0.0,
+            x.v[3] > 0 ? value.v[3] : 0.0}};
+    }
+    static void Frexp(const ScalarVec& x, ScalarVec& m, ScalarVec& e) { // x = m 2^e, m in [sqrt(1/2), sqrt(2)) for a normal x > 0
+        for (int k = 0; k < 4; ++k) {
+            uint64_t bits;
+            memcpy(&bits, &x.v[k], sizeof(bits));
+            bits += 0x3ff0000000000000ULL - 0x3fe6a09e667f3bcdULL;
+            e.v[k] = (double)((int64_t)(bits >> 52) - 0x3ff);
+            bits = (bits & 0x000fffffffffffffULL) + 0x3fe6a09e667f3bcdULL;
+            memcpy(&m.v[k], &bits, sizeof(bits));
+        }
+    }
+    void Store(double* p) const {
+        p[0] = v[0];
+        p[1] = v[1];
+        p[2] = v[2];
+        p[3] = v[3];
+    }
+
+    ScalarVec operator+(const ScalarVec& b) const {
+        return {{v[0] + b.v[0], v[1] + b.v[1], v[2] + b.v[2], v[3] + b.v[3]}};
+    }
+    ScalarVec operator-(const ScalarVec& b) const {
+        return {{v[0] - b.v[0], v[1] - b.v[1], v[2] - b.v[2], v[3] - b.v[3]}};
+    }
+    ScalarVec operator*(const ScalarVec& b) const {
+        return {{v[0] * b.v[0], v[1] * b.v[1], v[2] * b.v[2], v[3] * b.v[3]}};
+    }
+    ScalarVec operator/(const ScalarVec& b) const {
+        return {{v[0] / b.v[0], v[1] / b.v[1], v[2] / b.v[2], v[3] / b.v[3]}};
+    }
+};
+
+} // namespace
+
+const FeatureKernels& GetScalarFeatureKernels(int Ng) {
+    return SelectFeatureKernels<ScalarVec>(Ng);
+}
+
+const FeatureKernels& GetFeatureKernels(int Ng) {
+#if defined(GLCM_HAVE_AVX2)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2 ? GetAvx2FeatureKernels(Ng) : GetScalarFeatureKernels(Ng);
+#else
+    return GetScalarFeatureKernels(Ng);
+#endif
+}
+
+} // namespace glcm
@@ -0,0 +1,89 @@
+#ifndef GLCM_FEATURE_KERNELS_HPP_
+#define GLCM_FEATURE_KERNELS_HPP_
+
+namespace glcm {
+
+// Gray levels [begin, end) holding all the non-zero cells of the matrices; the kernels skip the zero rows and columns around it
+struct LevelRange {
+    int begin;
+    int end;
+};
+
+// c log c of the counts c < size, so the entropies of the count matrices need no logarithm per cell
+struct XLogXTable {
+    const double* values;
+    int size;
+};
+
+// Sums over the joint probabilities for the features that can not be derived from the marginals
+struct JointSums {
+    enum Which : unsigned {
+        Energy = 1 << 0,
+        Entropy = 1 << 1,
+        Maximum = 1 << 2,
+        AutoCorrelation = 1 << 3,
+        Correlation = 1 << 4,
+    };
+
+    double energy[4];           // sum(p^2)
+    double entropy[4];          // -sum(p log p)
+    double maximum[4];          // max(p)
+    double auto_correlation[4]; // sum(i j p)
+    double correlation[4];      // sum((i - mu_x) (j - mu_y) p)
+};
+
+// Feature kernels over the interleaved [i][j][direction] matrices of CooccurrenceMatrix. Every kernel handles the four directions
+// at once; per direction inputs and outputs are arrays of four doubles in the H, V, LD, RD order, and the marginals are written
+// interleaved as [k][direction]. The results are the same whatever the range, as long as it holds all the non-zero cells.
+struct FeatureKernels {
+    // The normalization, the marginals and the joint sums also take symmetric matrices holding the upper triangle only. The
+    // marginals and the joint sums are taken from the counts P and the pair totals R, without the probability matrices.
+    void (*normalize)(const int* P, int Ng, LevelRange range, bool symmetric, const double* R, double* p); // p = P / R
+    void (*marginals)(const int* P, int Ng, LevelRange range, bool symmetric, const double* R, double* px, double* py,
+        double* p_xpy, double* p_xny);
+
+    // -sum(x log x) over n interleaved [k][direction] elements (the marginals), with a vectorised logarithm within a few ulp
+    void (*entropy)(const double* x, int n, double* f);
+
+    void (*energy)(const double* p, int Ng, LevelRange range, double* f);           // sum(p^2)
+    void (*contrast)(const double* p, int Ng, LevelRange range, double* f);         // sum((i - j)^2 p)
+    void (*dissimilarity)(const double* p, int Ng, LevelRange range, double* f);    // sum(|i - j| p)
+    void (*homogeneity_i)(const double* p, int Ng, LevelRange range, double* f);    // sum(p / (1 + |i - j|))
+    void (*homogeneity_ii)(const double* p, int Ng, LevelRange range, double* f);   // sum(p / (1 + (i - j)^2))
+    void (*auto_correlation)(const double* p, int Ng, LevelRange range, double* f); // sum(i j p)
+    void (*inverse_difference_normalized)(const double* p, int Ng, LevelRange range,
+        double* f); // sum(p / (1 + (i - j)^2 / Ng)), integer division
+    void (*maximum_probability)(const double* p, int Ng, LevelRange range, double* f); // max(p)
+
+    void (*glcm_mean)(const double* p, int Ng, LevelRange range, double* mean_i, double* mean_j); // sum(i p), sum(j p)
+    void (*glcm_variance)(const double* p, int Ng, LevelRange range, const double* mean_i, const double* mean_j, double* var_i,
+        double* var_j);
+    void (*correlation)(const double* p, int Ng, LevelRange range, const double* mu_x, const double* mu_y, const double* sigma_x,
+        const double* sigma_y, double* f); // sum((i - mu_x) (j - mu_y) p / (sigma_x sigma_y))
+    void (*sum_of_squares)(const double* p, int Ng, LevelRange range, const double* mean_i, const double* mean_j, double* f);
+    void (*cluster_shade)(const double* p, int Ng, LevelRange range, const double* mu_x, const double* mu_y,
+        double* f); // sum((i + j - mu)^3 p)
+    void (*cluster_prominence)(const double* p, int Ng, LevelRange range, const double* mu_x, const double* mu_y,
+        double* f); // sum((i + j - mu)^4 p)
+
+    // the sums selected by "which" (JointSums::Which flags) in a single traversal of the matrices
+    void (*joint_sums)(const int* P, int Ng, LevelRange range, bool symmetric, const double* R, XLogXTable xlogx, const double* mu_x,
+        const double* mu_y, unsigned which, JointSums* sums);
+
+    // the same over the cells of a SparseCooccurrenceMatrix, giving the same results as the dense kernels
+    void (*sparse_marginals)(const int* rows, const int* cols, const int* counts, int num_cells, int Ng, bool symmetric,
+        const double* R, double* px, double* py, double* p_xpy, double* p_xny);
+    void (*sparse_joint_sums)(const int* rows, const int* cols, const int* counts, int num_cells, int Ng, bool symmetric,
+        const double* R, XLogXTable xlogx, const double* mu_x, const double* mu_y, unsigned which, JointSums* sums);
+};
+
+// Kernels for matrices of Ng gray levels: specialised at compile time for Ng = 8, 16, ..., 256, generic for any other Ng (and 0)
+const FeatureKernels& GetFeatureKernels(int Ng = 0);       // AVX2 kernels when the CPU supports them, otherwise the portable ones
+const FeatureKernels& GetScalarFeatureKernels(int Ng = 0); // portable kernels
+#if defined(GLCM_HAVE_AVX2)
+const FeatureKernels& GetAvx2FeatureKernels(int Ng = 0); // only call on CPUs supporting AVX2
+#endif
+
+} // namespace glcm
+
+#endif // GLCM_FEATURE_KERNELS_HPP_
@@ -0,0 +1,86 @@
+// Compiled with -mavx2 (see CMakeLists.txt). Nothing in here may run before GetFeatureKernels() has checked the CPU.
+#include "FeatureKernels.hpp"
+
+#if defined(GLCM_HAVE_AVX2)
+
+#include <immintrin.h>
+#include <math.h>
+
+#include "FeatureKernelsImpl.hpp"
+
+namespace glcm {
+
+namespace {
+
+// One AVX2 register holding the H, V, LD and RD values of a cell
+struct Avx2Vec {
+    __m256d v;
+
+    static Avx2Vec Zero() {
+        return {_mm256_setzero_pd()};
+    }
+    static Avx2Vec Broadcast(double x) {
+        return {_mm256_set1_pd(x)};
+    }
+    static Avx2Vec Load(const double* p) {
+        return {_mm256_loadu_pd(p)};
+    }
+    static Avx2Vec LoadInt(const int* p) {
+        return {_mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)))};
+    }
+    static Avx2Vec Max(const Avx2Vec& a, const Avx2Vec& b) {
+        return {_mm256_max_pd(a.v, b.v)};
+    }
+    static Avx2Vec XLogX(const Avx2Vec& x) { // x log(x), 0 where x <= 0; no vector log in AVX2, so per lane
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, x.v);
+        for (double& lane : lanes) {
+            lane = lane > 0 ? lane * log(lane) : 0.0;
+        }
+        return {_mm256_load_pd(lanes)};
+    }
+    static Avx2Vec Gather(const double* table, const int* index) {
+        // the masked form with all lanes set, since the plain one starts from an undefined register
+        __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        return {_mm256_mask_i32gather_pd(
+            _mm256_setzero_pd(), table, _mm_loadu_si128(reinterpret_cast<const __m128i*>(index)), all, sizeof(double))};
+    }
+    static Avx2Vec Positive(const Avx2Vec& x, const Avx2Vec& value) { // value where x > 0, otherwise 0
+        return {_mm256_and_pd(_mm256_cmp_pd(x.v, _mm256_setzero_pd(), _CMP_GT_OQ), value.v)};
+    }
+    static void Frexp(const Avx2Vec& x, Avx2Vec& m, Avx2Vec& e) { // x = m 2^e, m in [sqrt(1/2), sqrt(2)) for a normal x > 0
+        __m256i bits = _mm256_add_epi64(_mm256_castpd_si256(x.v), _mm256_set1_epi64x(0x3ff0000000000000LL - 0x3fe6a09e667f3bcdLL));
+        // the biased exponent n < 2^11 goes into the mantissa of 2^52, giving 2^52 + n exactly
+        __m256i exponent = _mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(0x4330000000000000LL));
+        e.v = _mm256_sub_pd(_mm256_castsi256_pd(exponent), _mm256_set1_pd(4503599627370496.0 + 0x3ff));
+        bits = _mm256_add_epi64(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffffLL)),
+            _mm256_set1_epi64x(0x3fe6a09e667f3bcdLL));
+        m.v = _mm256_castsi256_pd(bits);
+    }
+    void Store(double* p) const {
+        _mm256_storeu_pd(p, v);
+    }
+
+    Avx2Vec operator+(const Avx2Vec& b) const {
+        return {_mm256_add_pd(v, b.v)};
+    }
+    Avx2Vec operator-(const Avx2Vec& b) const {
+        return {_mm256_sub_pd(v, b.v)};
+    }
+    Avx2Vec operator*(const Avx2Vec& b) const {
+        return {_mm256_mul_pd(v, b.v)};
+    }
+    Avx2Vec operator/(const Avx2Vec& b) const {
+        return {_mm256_div_pd(v, b.v)};
+    }
+};
+
+} // namespace
+
+const FeatureKernels& GetAvx2FeatureKernels(int Ng) {
+    return SelectFeatureKernels<Avx2Vec>(Ng);
+}
+
+} // namespace glcm
+
+#endif // GLCM_HAVE_AVX2
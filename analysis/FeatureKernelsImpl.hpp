@@ -0,0 +1,614 @@
+#ifndef GLCM_FEATURE_KERNELS_IMPL_HPP_
+#define GLCM_FEATURE_KERNELS_IMPL_HPP_
+
+// Kernel bodies shared by FeatureKernels.cpp and FeatureKernelsAVX2.cpp. They are written once against a four lane vector type
+// "Vec" (one lane per direction) providing Zero, Broadcast, Load, LoadInt, Gather, Store, Max, Positive, XLogX, Frexp and the + - * /
+// operators. Each translation unit instantiates them with its own vector type declared in an anonymous namespace, so the
+// instantiations compiled with different instruction sets never get merged by the linker. The weights below do not depend on the
+// vector type, so they are in an anonymous namespace as well, which gives every translation unit its own copy. Both vector types do
+// the same operations in the same order, so the results do not depend on the selected kernels.
+//
+// The kernels are also instantiated for fixed numbers of gray levels, where the row strides and the loop bounds are constants and
+// the per cell weights are read from tables built at compile time. The weights are the same expressions in both cases, so the
+// specialised kernels give the same results as the generic ones.
+
+#include <cstddef>
+
+#include "CooccurrenceMatrix.hpp"
+#include "FeatureKernels.hpp"
+
+namespace glcm {
+
+namespace {
+
+// Weights of the dense kernels, as functions of n = |i - j| or of k = i + j
+constexpr double SquareWeight(int n) {
+    return n * n;
+}
+constexpr double AbsoluteWeight(int n) {
+    return n;
+}
+constexpr double InverseAbsoluteWeight(int n) {
+    return 1.0 / (1 + n);
+}
+constexpr double InverseSquareWeight(int n) {
+    return 1.0 / (1 + n * n);
+}
+constexpr double InverseNormalizedWeight(int n, int Ng) { // integer division, as in the original definition
+    return 1.0 / (1 + (n * n / Ng));
+}
+constexpr double SumWeight(int k) {
+    return k;
+}
+
+// The weights of all the n and k of Ng gray levels
+template <int Ng>
+struct alignas(64) WeightTables {
+    double square[Ng];
+    double absolute[Ng];
+    double inverse_absolute[Ng];
+    double inverse_square[Ng];
+    double inverse_normalized[Ng];
+    double sum[2 * Ng - 1];
+
+    constexpr WeightTables() : square(), absolute(), inverse_absolute(), inverse_square(), inverse_normalized(), sum() {
+        for (int n = 0; n < Ng; ++n) {
+            square[n] = SquareWeight(n);
+            absolute[n] = AbsoluteWeight(n);
+            inverse_absolute[n] = InverseAbsoluteWeight(n);
+            inverse_square[n] = InverseSquareWeight(n);
+            inverse_normalized[n] = InverseNormalizedWeight(n, Ng);
+        }
+        for (int k = 0; k < 2 * Ng - 1; ++k) {
+            sum[k] = SumWeight(k);
+        }
+    }
+};
+
+} // namespace
+
+// FixedNg > 0: kernels for matrices of FixedNg gray levels only, ignoring their Ng argument; 0: kernels for any Ng
+template <typename Vec, int FixedNg = 0>
+struct FeatureKernelsT {
+    static constexpr int Levels(int Ng) {
+        return (FixedNg > 0) ? FixedNg : Ng;
+    }
+
+    template <typename T>
+    static const T* Row(const T* p, int Ng, int i) {
+        return p + (std::size_t)i * Levels(Ng) * num_directions;
+    }
+
+    static constexpr WeightTables<(FixedNg > 0) ? FixedNg : 1> weights{};
+
+    static int Distance(int i, int j) {
+        return (i > j) ? i - j : j - i;
+    }
+    static Vec Square(int n) {
+        if constexpr (FixedNg > 0) {
+            return Vec::Broadcast(weights.square[n]);
+        } else {
+            return Vec::Broadcast(SquareWeight(n));
+        }
+    }
+    static Vec Absolute(int n) {
+        if constexpr (FixedNg > 0) {
+            return Vec::Broadcast(weights.absolute[n]);
+        } else {
+            return Vec::Broadcast(AbsoluteWeight(n));
+        }
+    }
+    static Vec InverseAbsolute(int n) {
+        if constexpr (FixedNg > 0) {
+            return Vec::Broadcast(weights.inverse_absolute[n]);
+        } else {
+            return Vec::Broadcast(InverseAbsoluteWeight(n));
+        }
+    }
+    static Vec InverseSquare(int n) {
+        if constexpr (FixedNg > 0) {
+            return Vec::Broadcast(weights.inverse_square[n]);
+        } else {
+            return Vec::Broadcast(InverseSquareWeight(n));
+        }
+    }
+    static Vec InverseNormalized(int n, int Ng) {
+        if constexpr (FixedNg > 0) {
+            return Vec::Broadcast(weights.inverse_normalized[n]);
+        } else {
+            return Vec::Broadcast(InverseNormalizedWeight(n, Ng));
+        }
+    }
+    static Vec SumOf(int i, int j) {
+        if constexpr (FixedNg > 0) {
+            return Vec::Broadcast(weights.sum[i + j]);
+        } else {
+            return Vec::Broadcast(SumWeight(i + j));
+        }
+    }
+
+    // The four directions of a cell, from the probabilities or from the counts
+    static Vec LoadCell(const double* cell) {
+        return Vec::Load(cell);
+    }
+    static Vec LoadCell(const int* cell) {
+        return Vec::LoadInt(cell);
+    }
+
+    // First j of the rows: the multiple of 4 at or below range.begin, so that every cell lands in the same accumulator as with the
+    // full range and skipping the zero cells leaves the sums bit for bit the same
+    static int AlignedBegin(LevelRange range) {
+        return range.begin & ~3;
+    }
+
+    // Sum of term(i, j, p_ij) over the range, with four accumulators over j to hide the latency of the additions
+    template <typename Term>
+    static Vec SumCells(const double* p, int Ng, LevelRange range, const Term& term) {
+        Vec acc[4] = {Vec::Zero(), Vec::Zero(), Vec::Zero(), Vec::Zero()};
+        for (int i = range.begin; i < range.end; ++i) {
+            AccumulateRow(Row(p, Ng, i), Ng, range, acc, [i, &term](int j, Vec p_ij) { return term(i, j, p_ij); });
+        }
+        return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    }
+
+    // Adds term(j, p_ij) over the cells of a row to the four accumulators of a sum
+    template <typename T, typename Term>
+    static void AccumulateRow(const T* row, int Ng, LevelRange range, Vec* acc, const Term& term) {
+        int j = AlignedBegin(range);
+        for (; (j + 4 <= Levels(Ng)) && (j < range.end); j += 4) {
+            acc[0] = acc[0] + term(j, LoadCell(row + j * num_directions));
+            acc[1] = acc[1] + term(j + 1, LoadCell(row + (j + 1) * num_directions));
+            acc[2] = acc[2] + term(j + 2, LoadCell(row + (j + 2) * num_directions));
+            acc[3] = acc[3] + term(j + 3, LoadCell(row + (j + 3) * num_directions));
+        }
+        for (; j < range.end; ++j) {
+            acc[0] = acc[0] + term(j, LoadCell(row + j * num_directions));
+        }
+    }
+
+    // Accumulators of one sum: four over j, plus the diagonal of the symmetric matrices, where only the upper triangle is stored
+    // and every off-diagonal cell stands for two cells of the full matrices
+    struct Sum {
+        Vec acc[4] = {Vec::Zero(), Vec::Zero(), Vec::Zero(), Vec::Zero()};
+        Vec diagonal = Vec::Zero();
+
+        void Store(bool symmetric, double* f) const {
+            Vec off_diagonal = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+            (symmetric ? off_diagonal + off_diagonal + diagonal : off_diagonal).Store(f);
+        }
+    };
+
+    // Adds term(j, p_ij) over row i of the range, or over its diagonal and upper triangle cells for the symmetric matrices
+    template <typename T, typename Term>
+    static void AccumulateSum(const T* row, int Ng, LevelRange range, int i, bool symmetric, Sum& sum, const Term& term) {
+        if (!symmetric) {
+            AccumulateRow(row, Ng, range, sum.acc, term);
+            return;
+        }
+        sum.diagonal = sum.diagonal + term(i, LoadCell(row + i * num_directions));
+        int j = i + 1;
+        for (; j + 4 <= range.end; j += 4) {
+            sum.acc[0] = sum.acc[0] + term(j, LoadCell(row + j * num_directions));
+            sum.acc[1] = sum.acc[1] + term(j + 1, LoadCell(row + (j + 1) * num_directions));
+            sum.acc[2] = sum.acc[2] + term(j + 2, LoadCell(row + (j + 2) * num_directions));
+            sum.acc[3] = sum.acc[3] + term(j + 3, LoadCell(row + (j + 3) * num_directions));
+        }
+        for (; j < range.end; ++j) {
+            sum.acc[0] = sum.acc[0] + term(j, LoadCell(row + j * num_directions));
+        }
+    }
+
+    // Adds the term of the sparse cell (i, j) to the accumulator the dense kernels would use
+    static void AccumulateCell(int Ng, int i, int j, bool symmetric, Sum& sum, Vec term) {
+        if (symmetric && (i == j)) {
+            sum.diagonal = sum.diagonal + term;
+        } else {
+            int slot = Slot(Ng, j);
+            sum.acc[slot] = sum.acc[slot] + term;
+        }
+    }
+
+    static void AddTo(double* target, Vec value) {
+        (Vec::Load(target) + value).Store(target);
+    }
+
+    // Natural logarithm of a normal x > 0 as e log(2) + log(m), with x = m 2^e and log(m) = 2 atanh(s) = 2 (s + s^3 / 3 + ...) for
+    // s = (m - 1) / (m + 1), |s| < 0.172; the series is cut after s^23, below 1e-19 of the result, so the error stays within a few ulp
+    static Vec Log(const Vec& x) {
+        Vec m;
+        Vec e;
+        Vec::Frexp(x, m, e);
+        Vec one = Vec::Broadcast(1.0);
+        Vec s = (m - one) / (m + one);
+        Vec z = s * s;
+        Vec series = Vec::Broadcast(1.0 / 23);
+        for (int k = 21; k >= 1; k -= 2) {
+            series = series * z + Vec::Broadcast(1.0 / k);
+        }
+        // log(2) split so that e log2_hi is exact
+        const double log2_hi = 6.93147180369123816490e-01;
+        const double log2_lo = 1.90821492927058770002e-10;
+        return e * Vec::Broadcast(log2_hi) + (e * Vec::Broadcast(log2_lo) + (s + s) * series);
+    }
+
+    // c log c of the four counts of a cell, looked up in the table when it holds them
+    static Vec CountXLogX(const int* cell, XLogXTable xlogx) {
+        if ((cell[0] < xlogx.size) && (cell[1] < xlogx.size) && (cell[2] < xlogx.size) && (cell[3] < xlogx.size)) {
+            return Vec::Gather(xlogx.values, cell);
+        }
+        return Vec::XLogX(Vec::LoadInt(cell));
+    }
+
+    static void ClearMarginals(int Ng, double* px, double* py, double* p_xpy, double* p_xny) {
+        Ng = Levels(Ng);
+        for (int k = 0; k < Ng * num_directions; ++k) {
+            px[k] = 0.0;
+            py[k] = 0.0;
+            p_xny[k] = 0.0;
+        }
+        for (int k = 0; k < (2 * Ng - 1) * num_directions; ++k) {
+            p_xpy[k] = 0.0;
+        }
+    }
+
+    // Divides the marginal counts by R, giving the marginal probabilities
+    static void ScaleMarginals(int Ng, const double* R, double* px, double* py, double* p_xpy, double* p_xny) {
+        Ng = Levels(Ng);
+        Vec r = Vec::Load(R);
+        for (int k = 0; k < Ng * num_directions; k += num_directions) {
+            (Vec::Load(px + k) / r).Store(px + k);
+            (Vec::Load(py + k) / r).Store(py + k);
+            (Vec::Load(p_xny + k) / r).Store(p_xny + k);
+        }
+        for (int k = 0; k < (2 * Ng - 1) * num_directions; k += num_directions) {
+            (Vec::Load(p_xpy + k) / r).Store(p_xpy + k);
+        }
+    }
+
+    // Turns the sums over the counts c = p R into the sums over the probabilities: sum(p^2) = sum(c^2) / R^2,
+    // -sum(p log p) = (R log R - sum(c log c)) / R, which is exactly 0 for a single cell, and the other sums are linear in p
+    static void ScaleJointSums(const double* R, JointSums* sums) {
+        Vec r = Vec::Load(R);
+        (Vec::Load(sums->energy) / (r * r)).Store(sums->energy);
+        ((Vec::XLogX(r) + Vec::Load(sums->entropy)) / r).Store(sums->entropy);
+        (Vec::Load(sums->maximum) / r).Store(sums->maximum);
+        (Vec::Load(sums->auto_correlation) / r).Store(sums->auto_correlation);
+        (Vec::Load(sums->correlation) / r).Store(sums->correlation);
+
+        // without any pair p = 0 / 0 in every cell, which the entropy and the maximum skip
+        for (int d = 0; d < num_directions; ++d) {
+            if (R[d] == 0) {
+                sums->entropy[d] = 0.0;
+                sums->maximum[d] = 0.0;
+            }
+        }
+    }
+
+    static void Normalize(const int* P, int Ng, LevelRange range, bool symmetric, const double* R, double* p) {
+        Vec r = Vec::Load(R);
+        for (int i = range.begin; i < range.end; ++i) {
+            std::size_t row = (std::size_t)i * Levels(Ng) * num_directions;
+            for (int j = symmetric ? i : range.begin; j < range.end; ++j) {
+                std::size_t k = row + j * num_directions;
+                (Vec::LoadInt(P + k) / r).Store(p + k);
+            }
+        }
+    }
+
+    static void Marginals(const int* P, int Ng, LevelRange range, bool symmetric, const double* R, double* px, double* py,
+        double* p_xpy, double* p_xny) {
+        ClearMarginals(Ng, px, py, p_xpy, p_xny);
+
+        if (symmetric) {
+            // c_ij = c_ji: the cell adds to p_x(i) and p_x(j), and twice to p_{x+y} and p_{x-y} off the diagonal
+            for (int i = range.begin; i < range.end; ++i) {
+                const int* row = Row(P, Ng, i);
+                for (int j = i; j < range.end; ++j) {
+                    Vec c_ij = Vec::LoadInt(row + j * num_directions);
+                    AddTo(px + i * num_directions, c_ij);
+                    if (j > i) {
+                        AddTo(px + j * num_directions, c_ij);
+                        c_ij = c_ij + c_ij;
+                    }
+                    AddTo(p_xpy + (i + j) * num_directions, c_ij);
+                    AddTo(p_xny + (j - i) * num_directions, c_ij);
+                }
+            }
+            for (int k = 0; k < Ng * num_directions; ++k) {
+                py[k] = px[k];
+            }
+        } else {
+            for (int i = range.begin; i < range.end; ++i) {
+                const int* row = Row(P, Ng, i);
+                Vec px_i = Vec::Zero();
+                for (int j = range.begin; j < range.end; ++j) {
+                    Vec c_ij = Vec::LoadInt(row + j * num_directions);
+                    px_i = px_i + c_ij;
+                    AddTo(py + j * num_directions, c_ij);
+                    AddTo(p_xpy + (i + j) * num_directions, c_ij);
+                    AddTo(p_xny + (i > j ? i - j : j - i) * num_directions, c_ij);
+                }
+                px_i.Store(px + i * num_directions);
+            }
+        }
+
+        // the sums of counts are exact, so the probabilities get a single rounding
+        ScaleMarginals(Ng, R, px, py, p_xpy, p_xny);
+    }
+
+    static void Entropy(const double* x, int n, double* f) {
+        Vec acc[2] = {Vec::Zero(), Vec::Zero()};
+        for (int k = 0; k < n; ++k) {
+            Vec x_k = Vec::Load(x + k * num_directions);
+            acc[k & 1] = acc[k & 1] - Vec::Positive(x_k, x_k * Log(x_k));
+        }
+        (acc[0] + acc[1]).Store(f);
+    }
+
+    static void Energy(const double* p, int Ng, LevelRange range, double* f) {
+        SumCells(p, Ng, range, [](int, int, Vec p_ij) { return p_ij * p_ij; }).Store(f);
+    }
+
+    static void Contrast(const double* p, int Ng, LevelRange range, double* f) {
+        SumCells(p, Ng, range, [](int i, int j, Vec p_ij) { return Square(Distance(i, j)) * p_ij; }).Store(f);
+    }
+
+    static void Dissimilarity(const double* p, int Ng, LevelRange range, double* f) {
+        SumCells(p, Ng, range, [](int i, int j, Vec p_ij) { return Absolute(Distance(i, j)) * p_ij; }).Store(f);
+    }
+
+    static void HomogeneityI(const double* p, int Ng, LevelRange range, double* f) {
+        SumCells(p, Ng, range, [](int i, int j, Vec p_ij) { return p_ij * InverseAbsolute(Distance(i, j)); }).Store(f);
+    }
+
+    static void HomogeneityII(const double* p, int Ng, LevelRange range, double* f) {
+        SumCells(p, Ng, range, [](int i, int j, Vec p_ij) { return p_ij * InverseSquare(Distance(i, j)); }).Store(f);
+    }
+
+    static void AutoCorrelation(const double* p, int Ng, LevelRange range, double* f) {
+        SumCells(p, Ng, range, [](int i, int j, Vec p_ij) { return Vec::Broadcast(i * j) * p_ij; }).Store(f);
+    }
+
+    static void InverseDifferenceNormalized(const double* p, int Ng, LevelRange range, double* f) {
+        SumCells(p, Ng, range, [Ng](int i, int j, Vec p_ij) { return p_ij * InverseNormalized(Distance(i, j), Ng); }).Store(f);
+    }
+
+    static void MaximumProbability(const double* p, int Ng, LevelRange range, double* f) {
+        Vec max = Vec::Zero();
+        for (int i = range.begin; i < range.end; ++i) {
+            const double* row = Row(p, Ng, i);
+            for (int j = range.begin; j < range.end; ++j) {
+                max = Vec::Max(Vec::Load(row + j * num_directions), max);
+            }
+        }
+        max.Store(f);
+    }
+
+    static void GLCMMean(const double* p, int Ng, LevelRange range, double* mean_i, double* mean_j) {
+        SumCells(p, Ng, range, [](int i, int, Vec p_ij) { return Vec::Broadcast(i) * p_ij; }).Store(mean_i);
+        SumCells(p, Ng, range, [](int, int j, Vec p_ij) { return Vec::Broadcast(j) * p_ij; }).Store(mean_j);
+    }
+
+    static void GLCMVariance(const double* p, int Ng, LevelRange range, const double* mean_i, const double* mean_j, double* var_i,
+        double* var_j) {
+        Vec mu_i = Vec::Load(mean_i);
+        Vec mu_j = Vec::Load(mean_j);
+        SumCells(p, Ng, range, [mu_i](int i, int, Vec p_ij) {
+            Vec d = Vec::Broadcast(i) - mu_i;
+            return d * d * p_ij;
+        }).Store(var_i);
+        SumCells(p, Ng, range, [mu_j](int, int j, Vec p_ij) {
+            Vec d = Vec::Broadcast(j) - mu_j;
+            return d * d * p_ij;
+        }).Store(var_j);
+    }
+
+    static void Correlation(const double* p, int Ng, LevelRange range, const double* mu_x, const double* mu_y, const double* sigma_x,
+        const double* sigma_y, double* f) {
+        Vec m_x = Vec::Load(mu_x);
+        Vec m_y = Vec::Load(mu_y);
+        Vec s_xy = Vec::Load(sigma_x) * Vec::Load(sigma_y);
+        SumCells(p, Ng, range, [m_x, m_y, s_xy](int i, int j, Vec p_ij) {
+            return (Vec::Broadcast(i) - m_x) * (Vec::Broadcast(j) - m_y) * p_ij / s_xy;
+        }).Store(f);
+    }
+
+    static void SumOfSquares(const double* p, int Ng, LevelRange range, const double* mean_i, const double* mean_j, double* f) {
+        Vec mu_i = Vec::Load(mean_i);
+        Vec mu_j = Vec::Load(mean_j);
+        SumCells(p, Ng, range, [mu_i, mu_j](int i, int j, Vec p_ij) {
+            Vec d_i = Vec::Broadcast(i) - mu_i;
+            Vec d_j = Vec::Broadcast(j) - mu_j;
+            return d_i * d_i * p_ij + d_j * d_j * p_ij;
+        }).Store(f);
+    }
+
+    static void ClusterShade(const double* p, int Ng, LevelRange range, const double* mu_x, const double* mu_y, double* f) {
+        Vec m_x = Vec::Load(mu_x);
+        Vec m_y = Vec::Load(mu_y);
+        SumCells(p, Ng, range, [m_x, m_y](int i, int j, Vec p_ij) {
+            Vec d = SumOf(i, j) - m_x - m_y;
+            return d * d * d * p_ij;
+        }).Store(f);
+    }
+
+    static void ClusterProminence(const double* p, int Ng, LevelRange range, const double* mu_x, const double* mu_y, double* f) {
+        Vec m_x = Vec::Load(mu_x);
+        Vec m_y = Vec::Load(mu_y);
+        SumCells(p, Ng, range, [m_x, m_y](int i, int j, Vec p_ij) {
+            Vec d = SumOf(i, j) - m_x - m_y;
+            Vec d2 = d * d;
+            return d2 * d2 * p_ij;
+        }).Store(f);
+    }
+
+    static void JointSumsKernel(const int* P, int Ng, LevelRange range, bool symmetric, const double* R, XLogXTable xlogx,
+        const double* mu_x, const double* mu_y, unsigned which, JointSums* sums) {
+        Sum energy;
+        Sum entropy;
+        Sum auto_correlation;
+        Sum correlation;
+        Vec maximum = Vec::Zero();
+        Vec m_x = Vec::Load(mu_x);
+        Vec m_y = Vec::Load(mu_y);
+
+        // the requested sums run one after another over a row while it is in the L1 cache, so the counts are read from memory
+        // once whatever the number of sums
+        for (int i = range.begin; i < range.end; ++i) {
+            const int* row = Row(P, Ng, i);
+            if (which & JointSums::Energy) {
+                AccumulateSum(row, Ng, range, i, symmetric, energy, [](int, Vec c_ij) { return c_ij * c_ij; });
+            }
+            if (which & JointSums::Entropy) {
+                AccumulateSum(row, Ng, range, i, symmetric, entropy, [row, xlogx](int j, Vec) {
+                    return Vec::Zero() - CountXLogX(row + j * num_directions, xlogx);
+                });
+            }
+            if (which & JointSums::AutoCorrelation) {
+                AccumulateSum(row, Ng, range, i, symmetric, auto_correlation, [i](int j, Vec c_ij) {
+                    return Vec::Broadcast(i * j) * c_ij;
+                });
+            }
+            if (which & JointSums::Correlation) {
+                Vec d_i = Vec::Broadcast(i) - m_x;
+                AccumulateSum(row, Ng, range, i, symmetric, correlation, [d_i, m_y](int j, Vec c_ij) {
+                    return d_i * (Vec::Broadcast(j) - m_y) * c_ij;
+                });
+            }
+            if (which & JointSums::Maximum) {
+                for (int j = symmetric ? i : range.begin; j < range.end; ++j) {
+                    maximum = Vec::Max(Vec::LoadInt(row + j * num_directions), maximum);
+                }
+            }
+        }
+
+        energy.Store(symmetric, sums->energy);
+        entropy.Store(symmetric, sums->entropy);
+        auto_correlation.Store(symmetric, sums->auto_correlation);
+        correlation.Store(symmetric, sums->correlation);
+        maximum.Store(sums->maximum);
+        ScaleJointSums(R, sums);
+    }
+
+    // Accumulator AccumulateRow adds the cell (i, j) to
+    static int Slot(int Ng, int j) {
+        return (j < (Levels(Ng) & ~3)) ? (j & 3) : 0;
+    }
+
+    static void SparseMarginals(const int* rows, const int* cols, const int* counts, int num_cells, int Ng, bool symmetric,
+        const double* R, double* px, double* py, double* p_xpy, double* p_xny) {
+        ClearMarginals(Ng, px, py, p_xpy, p_xny);
+
+        // as the dense kernel, over the non-zero cells
+        for (int e = 0; e < num_cells; ++e) {
+            int i = rows[e];
+            int j = cols[e];
+            Vec c_ij = Vec::LoadInt(counts + (std::size_t)e * num_directions);
+            if (symmetric) {
+                AddTo(px + i * num_directions, c_ij);
+                if (j > i) {
+                    AddTo(px + j * num_directions, c_ij);
+                    c_ij = c_ij + c_ij;
+                }
+                AddTo(p_xpy + (i + j) * num_directions, c_ij);
+                AddTo(p_xny + (j - i) * num_directions, c_ij);
+            } else {
+                AddTo(px + i * num_directions, c_ij);
+                AddTo(py + j * num_directions, c_ij);
+                AddTo(p_xpy + (i + j) * num_directions, c_ij);
+                AddTo(p_xny + (i > j ? i - j : j - i) * num_directions, c_ij);
+            }
+        }
+        if (symmetric) {
+            for (int k = 0; k < Ng * num_directions; ++k) {
+                py[k] = px[k];
+            }
+        }
+
+        ScaleMarginals(Ng, R, px, py, p_xpy, p_xny);
+    }
+
+    static void SparseJointSums(const int* rows, const int* cols, const int* counts, int num_cells, int Ng, bool symmetric,
+        const double* R, XLogXTable xlogx, const double* mu_x, const double* mu_y, unsigned which, JointSums* sums) {
+        Sum energy;
+        Sum entropy;
+        Sum auto_correlation;
+        Sum correlation;
+        Vec maximum = Vec::Zero();
+        Vec m_x = Vec::Load(mu_x);
+        Vec m_y = Vec::Load(mu_y);
+
+        // every cell goes to the accumulator of the dense kernel and the zero cells it skips add nothing, so the sums are the same
+        for (int e = 0; e < num_cells; ++e) {
+            int i = rows[e];
+            int j = cols[e];
+            Vec c_ij = Vec::LoadInt(counts + (std::size_t)e * num_directions);
+            if (which & JointSums::Energy) {
+                AccumulateCell(Ng, i, j, symmetric, energy, c_ij * c_ij);
+            }
+            if (which & JointSums::Entropy) {
+                AccumulateCell(Ng, i, j, symmetric, entropy, Vec::Zero() - CountXLogX(counts + (std::size_t)e * num_directions, xlogx));
+            }
+            if (which & JointSums::AutoCorrelation) {
+                AccumulateCell(Ng, i, j, symmetric, auto_correlation, Vec::Broadcast(i * j) * c_ij);
+            }
+            if (which & JointSums::Correlation) {
+                AccumulateCell(Ng, i, j, symmetric, correlation, (Vec::Broadcast(i) - m_x) * (Vec::Broadcast(j) - m_y) * c_ij);
+            }
+            if (which & JointSums::Maximum) {
+                maximum = Vec::Max(c_ij, maximum);
+            }
+        }
+
+        energy.Store(symmetric, sums->energy);
+        entropy.Store(symmetric, sums->entropy);
+        auto_correlation.Store(symmetric, sums->auto_correlation);
+        correlation.Store(symmetric, sums->correlation);
+        maximum.Store(sums->maximum);
+        ScaleJointSums(R, sums);
+    }
+
+    static FeatureKernels Table() {
+        FeatureKernels table;
+        table.normalize = Normalize;
+        table.marginals = Marginals;
+        table.entropy = Entropy;
+        table.energy = Energy;
+        table.contrast = Contrast;
+        table.dissimilarity = Dissimilarity;
+        table.homogeneity_i = HomogeneityI;
+        table.homogeneity_ii = HomogeneityII;
+        table.auto_correlation = AutoCorrelation;
+        table.inverse_difference_normalized = InverseDifferenceNormalized;
+        table.maximum_probability = MaximumProbability;
+        table.glcm_mean = GLCMMean;
+        table.glcm_variance = GLCMVariance;
+        table.correlation = Correlation;
+        table.sum_of_squares = SumOfSquares;
+        table.cluster_shade = ClusterShade;
+        table.cluster_prominence = ClusterProminence;
+        table.joint_sums = JointSumsKernel;
+        table.sparse_marginals = SparseMarginals;
+        table.sparse_joint_sums = SparseJointSums;
+        return table;
+    }
+};
+
+// Kernels for the Ng of the matrices, specialised for 8, 16, ..., 256 gray levels and generic otherwise
+template <typename Vec>
+const FeatureKernels& SelectFeatureKernels(int Ng) {
+    static const FeatureKernels generic = FeatureKernelsT<Vec>::Table();
+    static const FeatureKernels fixed[] = {FeatureKernelsT<Vec, 8>::Table(), FeatureKernelsT<Vec, 16>::Table(),
+        FeatureKernelsT<Vec, 32>::Table(), FeatureKernelsT<Vec, 64>::Table(), FeatureKernelsT<Vec, 128>::Table(),
+        FeatureKernelsT<Vec, 256>::Table()};
+    for (int k = 0; k < (int)(sizeof(fixed) / sizeof(fixed[0])); ++k) {
+        if (Ng == (8 << k)) {
+            return fixed[k];
+        }
+    }
+    return generic;
+}
+
+} // namespace glcm
+
+#endif // GLCM_FEATURE_KERNELS_IMPL_HPP_
@@ -0,0 +1,425 @@
+#include "FeatureMapAnalysis.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace glcm {
+
+FeatureMapAnalysis::FeatureMapAnalysis(int Ng, int window_size, int distance)
+    : _Ng(TextureAnalysis::ValidLevels(Ng)), _window_size(window_size), _distance(distance), _engine(_Ng) {
+    if ((_window_size < 3) || (_window_size % 2 == 0)) {
+        std::cerr << "Invalid window size assignment (odd size >= 3)!\n";
+    }
+    _engine.CheckDistance(_distance);
+
+    // a cell holds at most both orders of all the pairs of a direction in the window
+    int max_count = 2 * std::max(_window_size, 0) * std::max(_window_size, 0);
+    _xlogx.resize(max_count + 1);
+    for (int c = 0; c <= max_count; ++c) {
+        _xlogx[c] = c > 0 ? c * log((double)c) : 0.0;
+    }
+}
+
+void FeatureMapAnalysis::SetNumThreads(int num_threads) {
+    _engine.SetNumThreads(num_threads);
+}
+
+void FeatureMapAnalysis::SetQuantization(Quantization quantization) {
+    _engine.SetQuantization(quantization);
+}
+
+void FeatureMapAnalysis::SetBinWidth(double bin_width) {
+    _engine.SetBinWidth(bin_width);
+}
+
+void FeatureMapAnalysis::SetPercentiles(double lower, double upper) {
+    _engine.SetPercentiles(lower, upper);
+}
+
+void FeatureMapAnalysis::SetWindow(double level, double width) {
+    _engine.SetWindow(level, width);
+}
+
+int FeatureMapAnalysis::Channel(const FeatureSet& types, Type type, Direction direction) {
+    if (!types.Has(type) || (direction == Direction::Avg)) {
+        return -1;
+    }
+    int index = 0;
+    types.ForEach([&](Type other) {
+        if (other < type) {
+            ++index;
+        }
+    });
+    return index * num_directions + static_cast<int>(direction);
+}
+
+void FeatureMapAnalysis::Calculate(const cv::Mat& image, const FeatureSet& types, cv::Mat& maps) {
+    if (image.type() != CV_8UC1) {
+        std::cerr << "Invalid image type (CV_8UC1)!\n";
+        return;
+    }
+    if ((_window_size < 3) || (_window_size % 2 == 0) || (_distance < 1)) {
+        return;
+    }
+
+    FeatureSet map_types = types;
+    for (Type type : {Type::MaximalCorrelationCoefficient, Type::Score, Type::Age}) {
+        if (map_types.Has(type)) {
+            std::cerr << "The feature maps leave out the maximal correlation coefficient, the score and the age!\n";
+            map_types.Remove(type);
+        }
+    }
+    int num_channels = 0;
+    FeatureSet linear_types;
+    FeatureSet count_types;
+    for (int k = 0; k < num_types; ++k) {
+        _channels[k] = -1;
+    }
+    map_types.ForEach([&](Type type) {
+        _channels[static_cast<int>(type)] = num_channels;
+        num_channels += num_directions;
+        if (IsPairLinear(type)) {
+            linear_types.Add(type);
+        } else {
+            count_types.Add(type);
+        }
+    });
+    if ((num_channels == 0) || (num_channels > CV_CN_MAX)) {
+        std::cerr << "Invalid feature types (1 ~ " << CV_CN_MAX / num_directions << " types)!\n";
+        return;
+    }
+    maps.create(image.rows, image.cols, CV_32FC(num_channels));
+
+    // the gray levels of the whole image
+    std::vector<long> histogram;
+    if (_engine.NeedsHistogram()) {
+        _engine.CountRectHistogram(image, histogram);
+    }
+    _engine.BuildLevels(histogram);
+
+    // the pair-linear maps, a job per type and direction
+    std::vector<std::pair<Type, int>> jobs;
+    linear_types.ForEach([&](Type type) {
+        for (int d = 0; d < num_directions; ++d) {
+            jobs.push_back({type, d});
+        }
+    });
+    if (!jobs.empty()) {
+        int num_bands = std::max(1, std::min(_engine._num_threads, (int)jobs.size()));
+        _weights.resize(std::max((int)_weights.size(), num_bands));
+        _integrals.resize(std::max((int)_integrals.size(), num_bands));
+        TextureAnalysis::RunBands(num_bands, [&](int band) {
+            for (std::size_t k = band; k < jobs.size(); k += num_bands) {
+                Type type = jobs[k].first;
+                int direction = jobs[k].second;
+                ProcessLinear(image, type, direction, _channels[static_cast<int>(type)] + direction, _weights[band], _integrals[band],
+                    maps);
+            }
+        });
+    }
+
+    // the other maps from the counts of the sliding window
+    if (count_types.Empty()) {
+        return;
+    }
+    int num_bands = std::max(1, std::min(_engine._num_threads, image.rows));
+    while (_workers.size() < num_bands) {
+        _workers.push_back({WindowCounts(), TextureAnalysis(_Ng), FeatureResults()});
+    }
+    TextureAnalysis::RunBands(num_bands, [&](int band) {
+        int row_begin = (int)((long)image.rows * band / num_bands);
+        int row_end = (int)((long)image.rows * (band + 1) / num_bands);
+        ProcessRows(image, count_types, row_begin, row_end, _workers[band], maps);
+    });
+}
+
+bool FeatureMapAnalysis::IsPairLinear(Type type) {
+    switch (type) {
+        case Type::Contrast:
+        case Type::ContrastAnotherWay:
+        case Type::Dissimilarity:
+        case Type::HomogeneityI:
+        case Type::HomogeneityII:
+        case Type::InverseDifferenceNormalized:
+        case Type::InverseDifferenceMomentNormalized:
+        case Type::AutoCorrelation:
+            return true;
+        default:
+            return false;
+    }
+}
+
+double FeatureMapAnalysis::PairWeight(Type type, int i, int j) const {
+    // the weights of CalculateMarginalSums() and of the auto correlation kernel
+    int n = std::abs(i - j);
+    switch (type) {
+        case Type::Contrast:
+        case Type::ContrastAnotherWay:
+            return n * n;
+        case Type::Dissimilarity:
+            return n;
+        case Type::HomogeneityI:
+            return 1.0 / (1 + n);
+        case Type::HomogeneityII:
+            return 1.0 / (1 + n * n);
+        case Type::InverseDifferenceNormalized:
+        case Type::InverseDifferenceMomentNormalized:
+            return 1.0 / (1 + (n * n / _Ng));
+        case Type::AutoCorrelation:
+            return (double)i * j;
+        default:
+            return 0.0;
+    }
+}
+
+void FeatureMapAnalysis::ProcessLinear(const cv::Mat& image, Type type, int direction, int channel, std::vector<double>& weights,
+    std::vector<double>& integral, cv::Mat& maps) {
+    // Both orders of a pair have the same weight, so the feature of a window is the sum of the weights of its pairs over their number.
+    // A pair is anchored at its first pixel, and the pairs of a window are those anchored in a rectangle of it.
+    const uchar* level = _engine._levels.data();
+    weights.resize((std::size_t)_Ng * _Ng);
+    for (int i = 0; i < _Ng; ++i) {
+        for (int j = 0; j < _Ng; ++j) {
+            weights[i * _Ng + j] = PairWeight(type, i, j);
+        }
+    }
+
+    static const int dy_unit[num_directions] = {0, 1, 1, 1}; // H, V, LD and RD
+    static const int dx_unit[num_directions] = {1, 0, 1, -1};
+    int dy = dy_unit[direction] * _distance;
+    int dx = dx_unit[direction] * _distance;
+
+    int stride = image.cols + 1;
+    integral.assign((std::size_t)(image.rows + 1) * stride, 0.0);
+    for (int m = 0; m < image.rows; ++m) {
+        const double* above = integral.data() + (std::size_t)m * stride;
+        double* current = integral.data() + (std::size_t)(m + 1) * stride;
+        if (m + dy >= image.rows) {
+            std::copy(above, above + stride, current);
+            continue;
+        }
+        const uchar* row = image.ptr<uchar>(m);
+        const uchar* partner = image.ptr<uchar>(m + dy);
+        int n_begin = std::max(-dx, 0);
+        int n_end = image.cols - std::max(dx, 0);
+        double row_sum = 0.0;
+        for (int n = 0; n < image.cols; ++n) {
+            if ((n >= n_begin) && (n < n_end)) {
+                row_sum += weights[level[row[n]] * _Ng + level[partner[n + dx]]];
+            }
+            current[n + 1] = above[n + 1] + row_sum;
+        }
+    }
+
+    int half = _window_size / 2;
+    int num_channels = maps.channels();
+    for (int m = 0; m < image.rows; ++m) {
+        int row_begin = std::max(m - half, 0);
+        int row_end = std::min(m + half + 1, image.rows) - dy; // anchors of the pairs within the window
+        const double* top = integral.data() + (std::size_t)row_begin * stride;
+        const double* bottom = integral.data() + (std::size_t)std::max(row_end, row_begin) * stride;
+        float* map_row = maps.ptr<float>(m);
+        for (int n = 0; n < image.cols; ++n) {
+            int col_begin = std::max(n - half, 0) + std::max(-dx, 0);
+            int col_end = std::min(n + half + 1, image.cols) - std::max(dx, 0);
+            long num_pairs = (long)std::max(row_end - row_begin, 0) * std::max(col_end - col_begin, 0);
+            double value = std::numeric_limits<double>::quiet_NaN(); // no pairs, as 0 / 0 in the engine
+            if (num_pairs > 0) {
+                value = (bottom[col_end] - top[col_end] - bottom[col_begin] + top[col_begin]) / num_pairs;
+            }
+            map_row[(std::size_t)n * num_channels + channel] = (float)value;
+        }
+    }
+}
+
+void FeatureMapAnalysis::ProcessRows(const cv::Mat& image, const FeatureSet& types, int row_begin, int row_end, Worker& worker,
+    cv::Mat& maps) {
+    WindowCounts& counts = worker.counts;
+    counts.Reset(_Ng, (int)_xlogx.size() - 1);
+    counts.xlogx = _xlogx.data();
+
+    bool first_order = false;
+    for (Type type : {Type::Mean, Type::Std, Type::Skewness, Type::Kurtosis, Type::Median, Type::Percentile10, Type::Percentile90,
+             Type::FirstOrderEnergy, Type::FirstOrderEntropy}) {
+        first_order = first_order || types.Has(type);
+    }
+
+    int half = _window_size / 2;
+    for (int m = row_begin; m < row_end; ++m) {
+        int window_row_begin = std::max(m - half, 0);
+        int window_row_end = std::min(m + half + 1, image.rows);
+
+        // the window [begin, end) slides along the row, and leaves it empty again at its end
+        int begin = 0;
+        int end = 0;
+        float* map_row = maps.ptr<float>(m);
+        for (int n = 0; n < image.cols; ++n) {
+            while (end < std::min(n + half + 1, image.cols)) {
+                UpdateColumn(image, end, begin, end, window_row_begin, window_row_end, 1, counts);
+                ++end;
+            }
+            while (begin < n - half) {
+                UpdateColumn(image, begin, begin + 1, end, window_row_begin, window_row_end, -1, counts);
+                ++begin;
+            }
+
+            CalculateWindow(types, first_order, worker);
+            float* pixel = map_row + (std::size_t)n * maps.channels();
+            worker.results.ForEach([&](Type type, const Features& f) {
+                if (!types.Has(type)) {
+                    return; // set along with a selected type
+                }
+                float* values = pixel + _channels[static_cast<int>(type)];
+                values[0] = (float)f.H;
+                values[1] = (float)f.V;
+                values[2] = (float)f.LD;
+                values[3] = (float)f.RD;
+            });
+        }
+        while (begin < end) {
+            UpdateColumn(image, begin, begin + 1, end, window_row_begin, window_row_end, -1, counts);
+            ++begin;
+        }
+    }
+}
+
+void FeatureMapAnalysis::UpdateColumn(const cv::Mat& image, int n, int begin, int end, int row_begin, int row_end, int change,
+    WindowCounts& counts) {
+    // The pairs of the offsets (0, d), (d, 0), (d, d) and (d, -d) with one pixel in the column n and the other one in it or in the
+    // columns [begin, end), all within the rows [row_begin, row_end)
+    const uchar* level = _engine._levels.data();
+    int d = _distance;
+    bool left = (n - d >= begin) && (n - d < end);   // the column n - d is in the window
+    bool right = (n + d >= begin) && (n + d < end); // the column n + d is in the window
+
+    for (int m = row_begin; m < row_end; ++m) {
+        const uchar* row = image.ptr<uchar>(m);
+        int a = level[row[n]];
+        counts.UpdatePixel(row[n], change);
+
+        if (left) { // 0 degree
+            counts.UpdatePair(level[row[n - d]], a, 0, change);
+        }
+        if (right) {
+            counts.UpdatePair(a, level[row[n + d]], 0, change);
+        }
+
+        if (m + d >= row_end) {
+            continue;
+        }
+        const uchar* row_below = image.ptr<uchar>(m + d);
+        counts.UpdatePair(a, level[row_below[n]], 1, change); // 90 degree
+        if (left) {
+            counts.UpdatePair(level[row[n - d]], level[row_below[n]], 2, change); // 135 degree
+            counts.UpdatePair(a, level[row_below[n - d]], 3, change);             // 45 degree
+        }
+        if (right) {
+            counts.UpdatePair(a, level[row_below[n + d]], 2, change);
+            counts.UpdatePair(level[row[n + d]], level[row_below[n]], 3, change);
+        }
+    }
+}
+
+void FeatureMapAnalysis::CalculateWindow(const FeatureSet& types, bool first_order, Worker& worker) {
+    // The engine is given the state Normalization() leaves, from the counts of the window: the pair totals, the marginals and the
+    // pixel value histogram, then the joint sums follow from the sums of the counts as in the kernels.
+    const WindowCounts& counts = worker.counts;
+    TextureAnalysis& engine = worker.engine;
+    engine.ResetFactors();
+    engine._R_H = counts.R[0];
+    engine._R_V = counts.R[1];
+    engine._R_LD = counts.R[2];
+    engine._R_RD = counts.R[3];
+    double R[num_directions] = {(double)counts.R[0], (double)counts.R[1], (double)counts.R[2], (double)counts.R[3]};
+
+    engine._marginals.resize((5 * _Ng - 1) * num_directions);
+    double* px = engine._marginals.data();
+    double* py = px + _Ng * num_directions;
+    double* p_xny = py + _Ng * num_directions;
+    double* p_xpy = p_xny + _Ng * num_directions;
+    for (int k = 0; k < _Ng * num_directions; k += num_directions) {
+        for (int d = 0; d < num_directions; ++d) {
+            px[k + d] = counts.px[k + d] / R[d];
+            py[k + d] = px[k + d];
+            p_xny[k + d] = counts.p_xny[k + d] / R[d];
+        }
+    }
+    for (int k = 0; k < (2 * _Ng - 1) * num_directions; k += num_directions) {
+        for (int d = 0; d < num_directions; ++d) {
+            p_xpy[k + d] = counts.p_xpy[k + d] / R[d];
+        }
+    }
+    if (types.Has(Type::SumAverage) || types.Has(Type::SumVariance) || types.Has(Type::DifferenceVariance)) {
+        engine.SplitMarginals(); // only these still read the 0 degree copies
+    }
+
+    if (first_order) {
+        std::copy(counts.histogram.begin(), counts.histogram.end(), engine._histogram.begin());
+        engine.CalculatePixelStatistics();
+    }
+
+    engine.UpdateMoments();
+    JointSums joint;
+    for (int d = 0; d < num_directions; ++d) {
+        joint.energy[d] = counts.energy[d] / (R[d] * R[d]);
+        // a single cell holds all pairs: exactly 0, as in the kernels, rather than the rounding of R log R - R log R
+        joint.entropy[d] = (counts.maximum[d] < counts.R[d]) ? (R[d] * log(R[d]) - counts.entropy[d]) / R[d] : 0.0;
+        joint.maximum[d] = (R[d] > 0) ? counts.maximum[d] / R[d] : 0.0;
+        joint.auto_correlation[d] = counts.auto_correlation[d] / R[d];
+        joint.correlation[d] = joint.auto_correlation[d] - engine._stats.mu_x[d] * engine._stats.mu_y[d];
+    }
+    engine.SetJointEntropy(joint.entropy);
+    engine.CalculateFromSums(types, joint, worker.results);
+}
+
+void FeatureMapAnalysis::WindowCounts::Reset(int Ng_, int max_count) {
+    Ng = Ng_;
+    P.assign((std::size_t)Ng * Ng * num_directions, 0);
+    px.assign(Ng * num_directions, 0);
+    p_xpy.assign((2 * Ng - 1) * num_directions, 0);
+    p_xny.assign(Ng * num_directions, 0);
+    num_cells.assign((std::size_t)(max_count + 1) * num_directions, 0);
+    histogram.assign(256, 0);
+    for (int d = 0; d < num_directions; ++d) {
+        R[d] = 0;
+        maximum[d] = 0;
+        energy[d] = 0;
+        entropy[d] = 0.0;
+        auto_correlation[d] = 0;
+    }
+}
+
+void FeatureMapAnalysis::WindowCounts::UpdateCell(int i, int j, int direction, int change) {
+    int& cell = P[((std::size_t)i * Ng + j) * num_directions + direction];
+    int c = cell;
+    int c_new = c + change;
+    cell = c_new;
+
+    energy[direction] += (long)c_new * c_new - (long)c * c;
+    entropy[direction] += xlogx[c_new] - xlogx[c];
+
+    // the maximum only drops by one when its last cell is decremented, as that cell then holds the new maximum
+    --num_cells[c * num_directions + direction];
+    ++num_cells[c_new * num_directions + direction];
+    if (c_new > maximum[direction]) {
+        maximum[direction] = c_new;
+    } else if ((c == maximum[direction]) && (num_cells[c * num_directions + direction] == 0)) {
+        maximum[direction] = c_new;
+    }
+}
+
+void FeatureMapAnalysis::WindowCounts::UpdatePair(int a, int b, int direction, int change) {
+    UpdateCell(a, b, direction, change);
+    UpdateCell(b, a, direction, change);
+    px[a * num_directions + direction] += change;
+    px[b * num_directions + direction] += change;
+    p_xpy[(a + b) * num_directions + direction] += 2 * change;
+    p_xny[std::abs(a - b) * num_directions + direction] += 2 * change;
+    auto_correlation[direction] += 2L * a * b * change;
+    R[direction] += 2 * change;
+}
+
+} // namespace glcm
@@ -0,0 +1,94 @@
+#ifndef GLCM_FEATURE_MAP_ANALYSIS_HPP_
+#define GLCM_FEATURE_MAP_ANALYSIS_HPP_
+
+#include <vector>
+
+#include "TextureAnalysis.hpp"
+
+namespace glcm {
+
+// Per-pixel feature maps: every output pixel holds the features of the w x w window centered on it, clipped at the image borders,
+// as ProcessRectImage() finds them for that window. The window slides along the rows, so moving it by one column only adds the
+// pairs of the entering column and removes those of the leaving one. Along with the counts it updates the marginal counts and the
+// sums over the changed cells (energy, entropy, maximum and auto correlation), so a pixel costs O(w) updates and an O(Ng) pass
+// over the marginals instead of O(w^2) counts and an O(Ng^2) pass over the matrices. The rows are split into bands for the threads.
+// The pair-linear features, the means over the pairs of the window of a weight f(i, j), skip the counts: their maps are box sums of
+// the weight of every pair, anchored at its first pixel, read from an integral image, so a pixel costs O(1) whatever w and Ng.
+class FeatureMapAnalysis {
+public:
+    FeatureMapAnalysis(int Ng, int window_size, int distance); // odd window size of at least 3
+    ~FeatureMapAnalysis() = default;
+
+    // the settings of TextureAnalysis; the gray levels are those of the whole image
+    void SetNumThreads(int num_threads);
+    void SetQuantization(Quantization quantization);
+    void SetBinWidth(double bin_width);
+    void SetPercentiles(double lower, double upper);
+    void SetWindow(double level, double width);
+
+    // Maps of a CV_8UC1 image, as a CV_32FC(4 n) image for the n types: the channel 4 t + direction holds the type t of the set in the
+    // Type order, the directions in the H, V, LD and RD order. The maximal correlation coefficient, the score and the age are not
+    // available. The maps are reallocated only when their size or number of channels changes.
+    void Calculate(const cv::Mat& image, const FeatureSet& types, cv::Mat& maps);
+
+    // channel of a type and direction in the maps of the types, -1 if the type is not in them
+    static int Channel(const FeatureSet& types, Type type, Direction direction);
+    // whether the type is a mean of a weight of the pairs (contrast, dissimilarity, homogeneities, inverse differences and auto
+    // correlation), whose maps come from integral images
+    static bool IsPairLinear(Type type);
+
+private:
+    // Counts of the window, with both orders of every pair in the cells, and the sums kept up to date with them
+    struct WindowCounts {
+        void Reset(int Ng_, int max_count);
+        void UpdateCell(int i, int j, int direction, int change); // change of +/-1
+        void UpdatePair(int a, int b, int direction, int change); // the pair in both orders
+        void UpdatePixel(int pixel_value, int change) {
+            histogram[pixel_value] += change;
+        }
+
+        int Ng = 0;
+        std::vector<int> P;         // [i][j][direction] counts
+        std::vector<int> px;        // [i][direction] row sums, which are the column sums as well
+        std::vector<int> p_xpy;     // [i + j][direction] sums
+        std::vector<int> p_xny;     // [|i - j|][direction] sums
+        std::vector<int> num_cells; // [c][direction] number of cells holding the count c, to follow the maximum
+        std::vector<long> histogram; // pixel values of the window
+        const double* xlogx = nullptr; // c log c of the counts
+        int R[num_directions];
+        int maximum[num_directions];
+        long energy[num_directions];           // sum(c^2)
+        double entropy[num_directions];        // sum(c log c)
+        long auto_correlation[num_directions]; // sum(i j c)
+    };
+
+    // Buffers of a band of rows
+    struct Worker {
+        WindowCounts counts;
+        TextureAnalysis engine; // finishes the features of the windows
+        FeatureResults results;
+    };
+
+    void ProcessRows(const cv::Mat& image, const FeatureSet& types, int row_begin, int row_end, Worker& worker, cv::Mat& maps);
+    // map of a pair-linear type in a direction, written to the channel of the maps
+    void ProcessLinear(const cv::Mat& image, Type type, int direction, int channel, std::vector<double>& weights,
+        std::vector<double>& integral, cv::Mat& maps);
+    double PairWeight(Type type, int i, int j) const; // f(i, j) of a pair-linear type
+    // add (+1) or remove (-1) the column n, with its pairs towards the columns [begin, end) of the rows [row_begin, row_end)
+    void UpdateColumn(const cv::Mat& image, int n, int begin, int end, int row_begin, int row_end, int change, WindowCounts& counts);
+    void CalculateWindow(const FeatureSet& types, bool first_order, Worker& worker); // the features of the window
+
+    int _Ng;
+    int _window_size;
+    int _distance;
+    TextureAnalysis _engine;     // holds the settings and the gray levels of the image
+    std::vector<double> _xlogx;  // c log c up to the largest count of a window
+    std::vector<Worker> _workers; // one per band
+    std::vector<std::vector<double>> _weights;   // f(i, j) tables of the pair-linear maps, one per band
+    std::vector<std::vector<double>> _integrals; // integral images of the pair-linear maps, one per band
+    int _channels[num_types];                    // first channel of every type in the maps, -1 if not in them
+};
+
+} // namespace glcm
+
+#endif // GLCM_FEATURE_MAP_ANALYSIS_HPP_
@@ -0,0 +1,196 @@
+#include "MultiDistanceAnalysis.hpp"
+
+#include <algorithm>
+
+namespace glcm {
+
+MultiDistanceAnalysis::MultiDistanceAnalysis(int Ng, const std::vector<int>& distances) : _distances(distances) {
+    int levels = TextureAnalysis::ValidLevels(Ng); // reported once rather than by every engine
+    _engines.reserve(_distances.size());
+    for (int k = 0; k < _distances.size(); ++k) {
+        _engines.emplace_back(levels);
+        if (_engines[k].CheckDistance(_distances[k])) {
+            _active.push_back(k);
+        }
+    }
+    if (_distances.empty()) {
+        std::cerr << "Invalid distances assignment (no distance)!\n";
+    }
+}
+
+void MultiDistanceAnalysis::SetNumThreads(int num_threads) {
+    for (auto& engine : _engines) {
+        engine.SetNumThreads(num_threads);
+    }
+}
+
+void MultiDistanceAnalysis::SetQuantization(Quantization quantization) {
+    for (auto& engine : _engines) {
+        engine.SetQuantization(quantization);
+    }
+}
+
+void MultiDistanceAnalysis::SetBinWidth(double bin_width) {
+    for (auto& engine : _engines) {
+        engine.SetBinWidth(bin_width);
+    }
+}
+
+void MultiDistanceAnalysis::SetPercentiles(double lower, double upper) {
+    for (auto& engine : _engines) {
+        engine.SetPercentiles(lower, upper);
+    }
+}
+
+void MultiDistanceAnalysis::SetWindow(double level, double width) {
+    for (auto& engine : _engines) {
+        engine.SetWindow(level, width);
+    }
+}
+
+void MultiDistanceAnalysis::SetSymmetric(bool symmetric) {
+    for (auto& engine : _engines) {
+        engine.SetSymmetric(symmetric);
+    }
+}
+
+void MultiDistanceAnalysis::Prepare(const std::vector<long>& histogram, long counts_per_direction, bool rect) {
+    // the gray levels only depend on the pixel values, so they are found from the same histogram for all the distances
+    for (auto& engine : _engines) {
+        engine.ResetCache();
+        engine.BuildLevels(histogram);
+        engine._symmetric = rect && engine._symmetric_mode; // the polygons count both orders
+        engine._sparse = engine.UseSparse(counts_per_direction);
+    }
+}
+
+void MultiDistanceAnalysis::Finish(int num_bands) {
+    for (int k : _active) {
+        _engines[k].ReducePartials(num_bands);
+    }
+    for (auto& engine : _engines) {
+        engine.Normalization();
+    }
+}
+
+void MultiDistanceAnalysis::ProcessRectImage(const cv::Mat& image) {
+    if (_engines.empty()) {
+        return;
+    }
+    if (image.type() != CV_8UC1) {
+        std::cerr << "Invalid image type (CV_8UC1)!\n";
+        return;
+    }
+    TextureAnalysis& first = _engines.front();
+
+    std::vector<long> histogram;
+    if (first.NeedsHistogram()) {
+        first.CountRectHistogram(image, histogram);
+    }
+    Prepare(histogram, 2L * image.rows * image.cols, true);
+
+    // every band goes over its rows once, counting the pairs starting in a row for all the distances before the next row
+    int num_bands = first.CountBands(image.rows, (long)image.rows * image.cols);
+    for (int k : _active) {
+        _engines[k].PreparePartials(num_bands);
+    }
+    TextureAnalysis::RunBands(num_bands, [&](int band) {
+        int row_begin = (int)((long)image.rows * band / num_bands);
+        int row_end = (int)((long)image.rows * (band + 1) / num_bands);
+        for (int k : _active) {
+            TextureAnalysis& engine = _engines[k];
+            engine._partials[band].Reset(engine._Ng, engine._sparse, engine._symmetric);
+        }
+        for (int m = row_begin; m < row_end; ++m) {
+            for (int k : _active) {
+                _engines[k].AccumulateRectRows(image, _distances[k], m, m + 1, _engines[k]._partials[band]);
+            }
+        }
+        for (int k : _active) {
+            _engines[k].TrackRectLevels(image, _distances[k], row_end, _engines[k]._partials[band]);
+        }
+    });
+
+    Finish(num_bands);
+}
+
+void MultiDistanceAnalysis::ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image) {
+    ProcessPolygonImage(original_image, mask_image, cv::Rect(0, 0, mask_image.cols, mask_image.rows));
+}
+
+void MultiDistanceAnalysis::ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image, const cv::Rect& bounds) {
+    if (_engines.empty()) {
+        return;
+    }
+    if (original_image.type() != CV_8UC1) {
+        std::cerr << "Invalid image type (CV_8UC1)!\n";
+        return;
+    }
+    TextureAnalysis& first = _engines.front();
+
+    // the spans are found once and shared by the engines
+    first.ExtractMaskSpans(mask_image, bounds);
+    std::vector<long> histogram;
+    if (first.NeedsHistogram()) {
+        first.CountSpansHistogram(original_image, histogram);
+    }
+
+    std::vector<long> span_offsets(first._spans.size() + 1, 0); // number of non-masked pixels before each span
+    for (int s = 0; s < first._spans.size(); ++s) {
+        span_offsets[s + 1] = span_offsets[s] + first._spans[s].end - first._spans[s].begin;
+    }
+    Prepare(histogram, 2 * span_offsets.back(), false);
+    for (int k = 1; k < _engines.size(); ++k) {
+        _engines[k]._spans = first._spans;
+    }
+
+    // every band goes over its spans once, counting the pairs around a span for all the distances before the next span
+    int num_bands = first.CountBands((int)first._spans.size(), span_offsets.back());
+    for (int k : _active) {
+        _engines[k].PreparePartials(num_bands);
+    }
+    TextureAnalysis::RunBands(num_bands, [&](int band) {
+        long pixel_begin = span_offsets.back() * band / num_bands;
+        long pixel_end = span_offsets.back() * (band + 1) / num_bands;
+        int span_begin = std::lower_bound(span_offsets.begin(), span_offsets.end() - 1, pixel_begin) - span_offsets.begin();
+        int span_end = std::lower_bound(span_offsets.begin(), span_offsets.end() - 1, pixel_end) - span_offsets.begin();
+        for (int k : _active) {
+            TextureAnalysis& engine = _engines[k];
+            engine._partials[band].Reset(engine._Ng, engine._sparse, engine._symmetric);
+        }
+        for (int s = span_begin; s < span_end; ++s) {
+            for (int k : _active) {
+                _engines[k].AccumulatePolygon(original_image, _distances[k], s, s + 1, _engines[k]._partials[band]);
+            }
+        }
+    });
+
+    Finish(num_bands);
+}
+
+void MultiDistanceAnalysis::Calculate(const FeatureSet& types, std::vector<FeatureResults>& results, FeatureResults* average) {
+    results.resize(_engines.size());
+    for (int k = 0; k < _engines.size(); ++k) {
+        _engines[k].Calculate(types, results[k]);
+    }
+
+    if (average) {
+        average->Clear();
+        if (results.empty()) {
+            return;
+        }
+        results.front().ForEach([&](Type type, const Features&) {
+            Features sum = {0.0, 0.0, 0.0, 0.0};
+            for (const auto& result : results) {
+                sum.H += result[type].H;
+                sum.V += result[type].V;
+                sum.LD += result[type].LD;
+                sum.RD += result[type].RD;
+            }
+            double n = (double)results.size();
+            (*average)[type](sum.H / n, sum.V / n, sum.LD / n, sum.RD / n);
+        });
+    }
+}
+
+} // namespace glcm
@@ -0,0 +1,52 @@
+#ifndef GLCM_MULTI_DISTANCE_ANALYSIS_HPP_
+#define GLCM_MULTI_DISTANCE_ANALYSIS_HPP_
+
+#include <vector>
+
+#include "TextureAnalysis.hpp"
+
+namespace glcm {
+
+// Texture analysis of a region at several distances. The matrices of all the distances are filled in one sweep over the pixels:
+// every row (or span of the polygon) is read once and its pairs are counted for each distance while it is in the cache. Each
+// distance keeps its own engine, so its features are the same as those of a TextureAnalysis processing the region at that distance.
+class MultiDistanceAnalysis {
+public:
+    MultiDistanceAnalysis(int Ng, const std::vector<int>& distances);
+    ~MultiDistanceAnalysis() = default;
+
+    // the settings of TextureAnalysis, applied to the engines of all the distances
+    void SetNumThreads(int num_threads);
+    void SetQuantization(Quantization quantization);
+    void SetBinWidth(double bin_width);
+    void SetPercentiles(double lower, double upper);
+    void SetWindow(double level, double width);
+    void SetSymmetric(bool symmetric);
+
+    void ProcessRectImage(const cv::Mat& image);
+    void ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image);
+    void ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image, const cv::Rect& bounds);
+
+    // Features of every distance, in the order of the distances, and optionally their average over the distances. The results
+    // are resized on the first call only, so they can be reused for any number of regions.
+    void Calculate(const FeatureSet& types, std::vector<FeatureResults>& results, FeatureResults* average = nullptr);
+
+    const std::vector<int>& Distances() const {
+        return _distances;
+    }
+    TextureAnalysis& Engine(int k) { // engine of the distance k, holding its matrices after processing
+        return _engines[k];
+    }
+
+private:
+    void Prepare(const std::vector<long>& histogram, long counts_per_direction, bool rect); // reset the engines for a new region
+    void Finish(int num_bands);                                                // reduce and normalize the matrices
+
+    std::vector<int> _distances;
+    std::vector<TextureAnalysis> _engines; // one per distance
+    std::vector<int> _active;              // the engines of the valid distances, the others keep empty matrices
+};
+
+} // namespace glcm
+
+#endif // GLCM_MULTI_DISTANCE_ANALYSIS_HPP_
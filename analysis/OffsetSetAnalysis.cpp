@@ -0,0 +1,176 @@
+#include "OffsetSetAnalysis.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace glcm {
+
+OffsetSetAnalysis::OffsetSetAnalysis(int Ng, const std::vector<Offset>& offsets) : OffsetEngines(Ng, Downwards(offsets)) {
+    for (const auto& offset : _offsets) {
+        _max_dy = std::max(_max_dy, offset.dy);
+    }
+}
+
+std::vector<Offset> OffsetSetAnalysis::Downwards(const std::vector<Offset>& offsets) {
+    // the pairs are counted in both orders, so every offset is turned downwards and the rows above a band are never read
+    std::vector<Offset> downwards = offsets;
+    for (auto& offset : downwards) {
+        if ((offset.dy < 0) || ((offset.dy == 0) && (offset.dx < 0))) {
+            offset = {-offset.dy, -offset.dx};
+        }
+        if ((offset.dy == 0) && (offset.dx == 0)) {
+            std::cerr << "Invalid offset assignment (0, 0)!\n";
+        }
+    }
+    return downwards;
+}
+
+std::vector<Offset> OffsetSetAnalysis::AngleOffsets(int num_angles, int distance) {
+    std::vector<Offset> offsets;
+    if ((num_angles < 1) || (distance < 1)) {
+        std::cerr << "Invalid angles assignment (" << num_angles << " angles at distance " << distance << ")!\n";
+        return offsets;
+    }
+    // the half square at the chessboard distance d holds only 4 d distinct offsets
+    if (num_angles > 4 * distance) {
+        std::cerr << "Invalid angles assignment (at most " << 4 * distance << " angles at distance " << distance << ")!\n";
+        return offsets;
+    }
+
+    // the angle is counterclockwise from the columns axis, with the rows going down, and the offsets lie on the square at the
+    // chessboard distance, so 4 angles give the directions H, RD, V and LD
+    const double pi = std::acos(-1.0);
+    for (int k = 0; k < num_angles; ++k) {
+        double theta = pi * k / num_angles;
+        double scale = distance / std::max(std::abs(std::cos(theta)), std::abs(std::sin(theta)));
+        Offset offset = {-(int)std::lround(scale * std::sin(theta)), (int)std::lround(scale * std::cos(theta))};
+        if ((offset.dy < 0) || ((offset.dy == 0) && (offset.dx < 0))) {
+            offset = {-offset.dy, -offset.dx};
+        }
+        for (const Offset& other : offsets) {
+            if ((other.dy == offset.dy) && (other.dx == offset.dx)) { // a repeated offset would weigh twice in the averages
+                std::cerr << "Invalid angles assignment (" << num_angles << " angles round to the same offsets at distance " << distance
+                          << ")!\n";
+                return {};
+            }
+        }
+        offsets.push_back(offset);
+    }
+    return offsets;
+}
+
+std::vector<Offset> OffsetSetAnalysis::LegacyOffsets(int distance) {
+    return {{0, distance}, {distance, 0}, {distance, distance}, {distance, -distance}};
+}
+
+void OffsetSetAnalysis::Prepare(const std::vector<long>& histogram, long counts_per_direction, bool rect) {
+    // as in MultiDistanceAnalysis, the gray levels of all the engines come from the same histogram
+    for (auto& engine : _engines) {
+        engine.ResetCache();
+        engine.BuildLevels(histogram);
+        engine._symmetric = rect && engine._symmetric_mode; // the polygons count both orders
+        engine._sparse = engine.UseSparse(counts_per_direction);
+    }
+}
+
+void OffsetSetAnalysis::Finish(int num_bands) {
+    for (auto& engine : _engines) {
+        engine.ReducePartials(num_bands);
+        engine.Normalization();
+    }
+}
+
+void OffsetSetAnalysis::ProcessRectImage(const cv::Mat& image) {
+    if (_engines.empty()) {
+        return;
+    }
+    if (image.type() != CV_8UC1) {
+        std::cerr << "Invalid image type (CV_8UC1)!\n";
+        return;
+    }
+    TextureAnalysis& first = _engines.front();
+
+    std::vector<long> histogram;
+    if (first.NeedsHistogram()) {
+        first.CountRectHistogram(image, histogram);
+    }
+    Prepare(histogram, 2L * image.rows * image.cols, true);
+
+    // every band goes over its rows once, counting the pairs starting in a row for all the offsets before the next row
+    int num_bands = first.CountBands(image.rows, (long)image.rows * image.cols);
+    for (auto& engine : _engines) {
+        engine.PreparePartials(num_bands);
+    }
+    TextureAnalysis::RunBands(num_bands, [&](int band) {
+        int row_begin = (int)((long)image.rows * band / num_bands);
+        int row_end = (int)((long)image.rows * (band + 1) / num_bands);
+        for (auto& engine : _engines) {
+            engine._partials[band].Reset(engine._Ng, engine._sparse, engine._symmetric);
+        }
+        for (int m = row_begin; m < row_end; ++m) {
+            for (int k = 0; k < _engines.size(); ++k) {
+                _engines[k].AccumulateRectOffsets(image, _groups[k].data(), m, m + 1, _engines[k]._partials[band]);
+            }
+        }
+        for (auto& engine : _engines) {
+            engine.TrackRectLevels(image, _max_dy, row_end, engine._partials[band]);
+        }
+    });
+
+    Finish(num_bands);
+}
+
+void OffsetSetAnalysis::ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image) {
+    ProcessPolygonImage(original_image, mask_image, cv::Rect(0, 0, mask_image.cols, mask_image.rows));
+}
+
+void OffsetSetAnalysis::ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image, const cv::Rect& bounds) {
+    if (_engines.empty()) {
+        return;
+    }
+    if (original_image.type() != CV_8UC1) {
+        std::cerr << "Invalid image type (CV_8UC1)!\n";
+        return;
+    }
+    TextureAnalysis& first = _engines.front();
+
+    // the spans are found once and shared by the engines
+    first.ExtractMaskSpans(mask_image, bounds);
+    std::vector<long> histogram;
+    if (first.NeedsHistogram()) {
+        first.CountSpansHistogram(original_image, histogram);
+    }
+
+    std::vector<long> span_offsets(first._spans.size() + 1, 0); // number of non-masked pixels before each span
+    for (int s = 0; s < first._spans.size(); ++s) {
+        span_offsets[s + 1] = span_offsets[s] + first._spans[s].end - first._spans[s].begin;
+    }
+    Prepare(histogram, 2 * span_offsets.back(), false);
+    for (int k = 1; k < _engines.size(); ++k) {
+        _engines[k]._spans = first._spans;
+    }
+
+    // every band goes over its spans once, counting the pairs around a span for all the offsets before the next span
+    int num_bands = first.CountBands((int)first._spans.size(), span_offsets.back());
+    for (auto& engine : _engines) {
+        engine.PreparePartials(num_bands);
+    }
+    TextureAnalysis::RunBands(num_bands, [&](int band) {
+        long pixel_begin = span_offsets.back() * band / num_bands;
+        long pixel_end = span_offsets.back() * (band + 1) / num_bands;
+        int span_begin = std::lower_bound(span_offsets.begin(), span_offsets.end() - 1, pixel_begin) - span_offsets.begin();
+        int span_end = std::lower_bound(span_offsets.begin(), span_offsets.end() - 1, pixel_end) - span_offsets.begin();
+        for (auto& engine : _engines) {
+            engine._partials[band].Reset(engine._Ng, engine._sparse, engine._symmetric);
+        }
+        for (int s = span_begin; s < span_end; ++s) {
+            for (int k = 0; k < _engines.size(); ++k) {
+                _engines[k].AccumulatePolygonOffsets(original_image, _groups[k].data(), s, s + 1, _engines[k]._partials[band]);
+            }
+        }
+    });
+
+    Finish(num_bands);
+}
+
+} // namespace glcm
@@ -0,0 +1,173 @@
+#ifndef GLCM_OFFSET_SET_ANALYSIS_HPP_
+#define GLCM_OFFSET_SET_ANALYSIS_HPP_
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "TextureAnalysis.hpp"
+
+namespace glcm {
+
+// Features of any number of offsets, flat by type: the values of the offset k of a type are at [type][k]
+class OffsetResults {
+public:
+    void Resize(int num_offsets) {
+        if (_num_offsets != num_offsets) {
+            _num_offsets = num_offsets;
+            _values.assign((size_t)num_types * num_offsets, 0.0);
+        }
+    }
+    void Clear() {
+        _types.Clear();
+    }
+
+    double* operator[](Type type) { // the values of a type, which is marked as present
+        _types.Add(type);
+        return _values.data() + (size_t)type * _num_offsets;
+    }
+    const double* operator[](Type type) const {
+        return _values.data() + (size_t)type * _num_offsets;
+    }
+    double Avg(Type type) const { // average over the offsets
+        const double* values = (*this)[type];
+        double sum = 0.0;
+        for (int k = 0; k < _num_offsets; ++k) {
+            sum += values[k];
+        }
+        return _num_offsets > 0 ? sum / _num_offsets : 0.0;
+    }
+
+    bool Has(Type type) const {
+        return _types.Has(type);
+    }
+    const FeatureSet& Types() const {
+        return _types;
+    }
+    int NumOffsets() const {
+        return _num_offsets;
+    }
+
+private:
+    int _num_offsets = 0;
+    FeatureSet _types;
+    std::vector<double> _values;
+};
+
+// Engines of a set of offsets taken four at a time, as the four directions of a TextureAnalysis engine, the last group padded by
+// repeating its last offset. Base of the analyses of the 2-D and the 3-D offsets, which fill the matrices of the engines.
+template <typename OffsetT>
+class OffsetEngines {
+public:
+    // the settings of TextureAnalysis, applied to all the engines
+    void SetNumThreads(int num_threads) {
+        for (auto& engine : _engines) {
+            engine.SetNumThreads(num_threads);
+        }
+    }
+    void SetQuantization(Quantization quantization) {
+        for (auto& engine : _engines) {
+            engine.SetQuantization(quantization);
+        }
+    }
+    void SetBinWidth(double bin_width) {
+        for (auto& engine : _engines) {
+            engine.SetBinWidth(bin_width);
+        }
+    }
+    void SetPercentiles(double lower, double upper) {
+        for (auto& engine : _engines) {
+            engine.SetPercentiles(lower, upper);
+        }
+    }
+    void SetWindow(double level, double width) {
+        for (auto& engine : _engines) {
+            engine.SetWindow(level, width);
+        }
+    }
+    void SetSymmetric(bool symmetric) {
+        for (auto& engine : _engines) {
+            engine.SetSymmetric(symmetric);
+        }
+    }
+
+    // features of every offset, in the order of the offsets
+    void Calculate(const FeatureSet& types, OffsetResults& results) {
+        results.Resize((int)_offsets.size());
+        results.Clear();
+        for (int k = 0; k < _engines.size(); ++k) {
+            // the lanes of the engine are scattered to its offsets, dropping the padding of the last group
+            _engines[k].Calculate(types, _group_results);
+            int num_lanes = std::min(num_directions, (int)_offsets.size() - k * num_directions);
+            _group_results.ForEach([&](Type type, const Features& features) {
+                const double lanes[num_directions] = {features.H, features.V, features.LD, features.RD};
+                double* values = results[type] + k * num_directions;
+                for (int lane = 0; lane < num_lanes; ++lane) {
+                    values[lane] = lanes[lane];
+                }
+            });
+        }
+    }
+
+protected:
+    using OffsetGroup = std::array<OffsetT, num_directions>;
+
+    OffsetEngines(int Ng, const std::vector<OffsetT>& offsets) : _offsets(offsets) {
+        if (_offsets.empty()) {
+            std::cerr << "Invalid offsets assignment (no offset)!\n";
+            return;
+        }
+        for (int k = 0; k < _offsets.size(); k += num_directions) {
+            OffsetGroup group;
+            for (int lane = 0; lane < num_directions; ++lane) {
+                group[lane] = _offsets[std::min(k + lane, (int)_offsets.size() - 1)];
+            }
+            _groups.push_back(group);
+        }
+        int levels = TextureAnalysis::ValidLevels(Ng); // reported once rather than by every engine
+        _engines.reserve(_groups.size());
+        for (int k = 0; k < _groups.size(); ++k) {
+            _engines.emplace_back(levels);
+        }
+    }
+    ~OffsetEngines() = default;
+
+    std::vector<OffsetT> _offsets;
+    std::vector<OffsetGroup> _groups;      // the offsets of each engine
+    std::vector<TextureAnalysis> _engines; // one per group
+    FeatureResults _group_results;         // features of a group, before they are scattered to the offsets
+};
+
+// Texture analysis of a region for an arbitrary set of offsets. The engines of OffsetEngines take the offsets four at a time, so the
+// vectorised kernels process them together, and the matrices of all the engines are filled in one sweep over the pixels. The four
+// directions H, V, LD and RD of TextureAnalysis are the offsets LegacyOffsets(distance).
+class OffsetSetAnalysis : public OffsetEngines<Offset> {
+public:
+    OffsetSetAnalysis(int Ng, const std::vector<Offset>& offsets);
+    ~OffsetSetAnalysis() = default;
+
+    // offsets of num_angles angles evenly spread over 180 degrees, starting at 0 (H), at the chessboard distance; empty when the angles
+    // do not give distinct offsets, which needs num_angles <= 4 distance
+    static std::vector<Offset> AngleOffsets(int num_angles, int distance);
+    // the offsets of the directions H, V, LD and RD
+    static std::vector<Offset> LegacyOffsets(int distance);
+
+    void ProcessRectImage(const cv::Mat& image);
+    void ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image);
+    void ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image, const cv::Rect& bounds);
+
+    const std::vector<Offset>& Offsets() const { // normalized to dy > 0, or dy = 0 and dx > 0
+        return _offsets;
+    }
+
+private:
+    static std::vector<Offset> Downwards(const std::vector<Offset>& offsets); // the offsets of Offsets()
+    void Prepare(const std::vector<long>& histogram, long counts_per_direction, bool rect); // reset the engines for a new region
+    void Finish(int num_bands);                                                // reduce and normalize the matrices
+
+    int _max_dy = 0; // rows below a band read by its pairs
+};
+
+} // namespace glcm
+
+#endif // GLCM_OFFSET_SET_ANALYSIS_HPP_
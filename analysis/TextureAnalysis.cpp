@@ -8,26 +8,63 @@
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include <type_traits>
 
 const int white_color = 255;
 const int black_color = 0;
 
+const long min_pixels_per_band = 1 << 16; // smallest region worth a thread of its own
+const long sparse_cells_per_pair = 8;     // the sparse format is used with less than one pair per 8 cells of a direction
+const long max_xlogx_counts = 1 << 16;    // the c log c table stays within 512 KB, larger counts take the logarithm
+const int max_levels = 256;               // gray levels of the 8-bit tables, the level maps and the histograms
+
 using namespace glcm;
 
 namespace fs = std::filesystem;
 
-TextureAnalysis::TextureAnalysis(int Ng) : _Ng(Ng) {
+// calls function(T()) with the pixel type T of the 16-bit and floating-point images
+template <typename Function>
+static void DispatchWideDepth(int depth, Function function) {
+    switch (depth) {
+        case CV_16U:
+            function(ushort());
+            break;
+        case CV_32F:
+            function(float());
+            break;
+        case CV_64F:
+            function(double());
+            break;
+        default:
+            break;
+    }
+}
+
+TextureAnalysis::TextureAnalysis(int Ng)
+    : _Ng(ValidLevels(Ng)),
+      _num_threads(1),
+      _kernels(&GetFeatureKernels(_Ng)),
+      _quantization(Quantization::None),
+      _bin_width(256.0 / _Ng),
+      _lower_percentile(1.0),
+      _upper_percentile(99.0),
+      _window_level(128.0),
+      _window_width(256.0),
+      _levels(256, 0),
+      _level_map({0.0, 1.0, 1.0, 0}),
+      _range({_Ng, 0}),
+      _symmetric_mode(false),
+      _symmetric(false),
+      _sparse(false),
+      _normalized(false),
+      _histogram(256, 0) {
     if (Ng > 0) {
         // initialize probability matrices
-        _P_H.resize(_Ng, std::vector<int>(_Ng));
-        _P_V.resize(_Ng, std::vector<int>(_Ng));
-        _P_LD.resize(_Ng, std::vector<int>(_Ng));
-        _P_RD.resize(_Ng, std::vector<int>(_Ng));
-
-        _p_H.resize(_Ng, std::vector<double>(_Ng));
-        _p_V.resize(_Ng, std::vector<double>(_Ng));
-        _p_LD.resize(_Ng, std::vector<double>(_Ng));
-        _p_RD.resize(_Ng, std::vector<double>(_Ng));
+        _P.Resize(_Ng);
+        _p.Resize(_Ng);
 
         // initialize probability vectors
         _px_H.resize(_Ng);
@@ -60,38 +97,35 @@ TextureAnalysis::TextureAnalysis(int Ng) : _Ng(Ng) {
 void TextureAnalysis::ProcessRectImage(const cv::Mat& image, int distance) {
     // Clear the cache
     ResetCache();
+    bool wide = image.depth() != CV_8U;
 
-    // Calculate matrices elements: central pixel coord (m ,n), where "m" is the row index, and "n" is the column index
-    for (int m = 0; m < image.rows; ++m) {
-        for (int n = 0; n < image.cols; ++n) {
-            // Nearest neighborhood pixel coord (k ,l), where "k" is the row index, and "l" is the column index
-            for (int k = m - distance; k <= m + distance; ++k) {
-                for (int l = n - distance; l <= n + distance; ++l) {
-                    if ((k >= 0) && (l >= 0) && (k < image.rows) && (l < image.cols)) {
-                        //// ToDo: need to check are pixel values in coordinates (m,n) and (k,l) nan or masked!!
-                        int j = (int)(image.at<uchar>(m, n)); // I(m,n)
-                        int i = (int)(image.at<uchar>(k, l)); // I(k,l)
-                        if (((k - m) == 0) && (abs(l - n) == distance)) {
-                            CountElemH(i, j);
-                        } else if ((((k - m) == distance) && ((l - n) == -distance)) || (((k - m) == -distance) && ((l - n) == distance))) {
-                            CountElemRD(i, j);
-                        } else if ((abs(k - m) == distance) && (l - n == 0)) {
-                            CountElemV(i, j);
-                        } else if ((((k - m) == distance) && ((l - n) == distance)) || (((k - m) == -distance) && ((l - n) == -distance))) {
-                            CountElemLD(i, j);
-                        } else if ((m == k) && (n == l)) {
-                            PushPixelValue(i);
-                        } else {
-                            // if ((m != k) || (n != l)) {
-                            //    cerr << "unknown element:" << endl;
-                            //    cerr << "central element: (m, n) = (" << m << "," << n << ")" << endl;
-                            //    cerr << "neighborhood element: (k, l) = (" << k << "," << l << ")" << endl;
-                            //}
-                        }
-                    }
-                }
-            }
+    // Map the pixel values to the gray levels
+    std::vector<long> histogram;
+    if (wide) {
+        DispatchWideDepth(image.depth(), [&](auto pixel) { BuildLevelMap<decltype(pixel)>(image, false); });
+    } else {
+        if (NeedsHistogram()) {
+            CountRectHistogram(image, histogram);
         }
+        BuildLevels(histogram);
+    }
+
+    // Calculate matrices elements along the four fixed offsets, one band of rows per thread
+    if (CheckImage(image) && CheckDistance(distance)) {
+        _symmetric = _symmetric_mode;
+        _sparse = UseSparse(2L * image.rows * image.cols);
+        int num_bands = CountBands(image.rows, (long)image.rows * image.cols);
+        AccumulateBands(num_bands, [&](int band, Partial& partial) {
+            int row_begin = (int)((long)image.rows * band / num_bands);
+            int row_end = (int)((long)image.rows * (band + 1) / num_bands);
+            if (wide) {
+                DispatchWideDepth(image.depth(), [&](auto pixel) {
+                    AccumulateRectWide<decltype(pixel)>(image, distance, row_begin, row_end, partial);
+                });
+            } else {
+                AccumulateRect(image, distance, row_begin, row_end, partial);
+            }
+        });
     }
 
     // Normalize the matrices
@@ -99,778 +133,1227 @@ void TextureAnalysis::ProcessRectImage(const cv::Mat& image, int distance) {
 }
 
 void TextureAnalysis::ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image, int distance) {
+    ProcessPolygonImage(original_image, mask_image, distance, cv::Rect(0, 0, mask_image.cols, mask_image.rows));
+}
+
+void TextureAnalysis::ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image, int distance, const cv::Rect& bounds) {
     // Clear the cache
     ResetCache();
 
-    // Calculate matrices elements: central pixel coord (m ,n), where "m" is the row index, and "n" is the column index
-    int masked = 0;
-    int non_masked = 0;
-    for (int m = 0; m < original_image.rows; ++m) {
-        for (int n = 0; n < original_image.cols; ++n) {
-            // Nearest neighborhood pixel coord (k ,l), where "k" is the row index, and "l" is the column index
-            for (int k = m - distance; k <= m + distance; ++k) {
-                for (int l = n - distance; l <= n + distance; ++l) {
-                    if ((k >= 0) && (l >= 0) && (k < original_image.rows) && (l < original_image.cols)) {
-                        // Check is the nearest neighborhood pixel coord (k ,l) masked
-                        int mask_pixel_value = (int)(mask_image.at<uchar>(k, l));
-                        if (mask_pixel_value == white_color) {             // if nearest neighborhood pixel coord (k ,l) is not masked
-                            int j = (int)(original_image.at<uchar>(m, n)); // I(m,n)
-                            int i = (int)(original_image.at<uchar>(k, l)); // I(k,l)
-                            if (((k - m) == 0) && (abs(l - n) == distance)) {
-                                CountElemH(i, j);
-                            } else if ((((k - m) == distance) && ((l - n) == -distance)) ||
-                                       (((k - m) == -distance) && ((l - n) == distance))) {
-                                CountElemRD(i, j);
-                            } else if ((abs(k - m) == distance) && (l - n == 0)) {
-                                CountElemV(i, j);
-                            } else if ((((k - m) == distance) && ((l - n) == distance)) ||
-                                       (((k - m) == -distance) && ((l - n) == -distance))) {
-                                CountElemLD(i, j);
-                            } else if ((m == k) && (n == l)) {
-                                PushPixelValue(i);
-                            } else {
-                                // if ((m != k) || (n != l)) {
-                                //    cerr << "unknown element:" << endl;
-                                //    cerr << "central element: (m, n) = (" << m << "," << n << ")" << endl;
-                                //    cerr << "neighborhood element: (k, l) = (" << k << "," << l << ")" << endl;
-                                //}
-                            }
-                            ++non_masked;
-                        } else {
-                            // cerr << "masked coord: (k, l) = (" << k << "," << l << "), pixel value = " << mask_pixel_value << endl;
-                            ++masked;
-                        }
-                    }
-                }
-            }
+    // Get the row spans of the non-masked pixels inside the bounding box
+    ExtractMaskSpans(mask_image, bounds);
+
+    // Map the pixel values to the gray levels
+    bool wide = original_image.depth() != CV_8U;
+    std::vector<long> histogram;
+    if (wide) {
+        DispatchWideDepth(original_image.depth(), [&](auto pixel) { BuildLevelMap<decltype(pixel)>(original_image, true); });
+    } else {
+        if (NeedsHistogram()) {
+            CountSpansHistogram(original_image, histogram);
+        }
+        BuildLevels(histogram);
+    }
+
+    // Calculate matrices elements around the non-masked pixels only, one chunk of spans per thread
+    if (CheckImage(original_image) && CheckDistance(distance)) {
+        std::vector<long> span_offsets(_spans.size() + 1, 0); // number of non-masked pixels before each span
+        for (int k = 0; k < _spans.size(); ++k) {
+            span_offsets[k + 1] = span_offsets[k] + _spans[k].end - _spans[k].begin;
         }
+        _sparse = UseSparse(2 * span_offsets.back());
+        int num_bands = CountBands((int)_spans.size(), span_offsets.back());
+        AccumulateBands(num_bands, [&](int band, Partial& partial) {
+            // split the spans so that every chunk holds about the same number of pixels
+            long pixel_begin = span_offsets.back() * band / num_bands;
+            long pixel_end = span_offsets.back() * (band + 1) / num_bands;
+            int span_begin = std::lower_bound(span_offsets.begin(), span_offsets.end() - 1, pixel_begin) - span_offsets.begin();
+            int span_end = std::lower_bound(span_offsets.begin(), span_offsets.end() - 1, pixel_end) - span_offsets.begin();
+            if (wide) {
+                DispatchWideDepth(original_image.depth(), [&](auto pixel) {
+                    AccumulatePolygonWide<decltype(pixel)>(original_image, distance, span_begin, span_end, partial);
+                });
+            } else {
+                AccumulatePolygon(original_image, distance, span_begin, span_end, partial);
+            }
+        });
     }
 
     // Normalize the matrices
     Normalization();
 }
 
-void TextureAnalysis::ResetCache() {
-    // reset probability matrices as zeros
-    for (int i = 0; i < _Ng; ++i) {
-        std::fill(_P_H[i].begin(), _P_H[i].end(), 0);
-        std::fill(_P_V[i].begin(), _P_V[i].end(), 0);
-        std::fill(_P_LD[i].begin(), _P_LD[i].end(), 0);
-        std::fill(_P_RD[i].begin(), _P_RD[i].end(), 0);
-
-        std::fill(_p_H[i].begin(), _p_H[i].end(), 0);
-        std::fill(_p_V[i].begin(), _p_V[i].end(), 0);
-        std::fill(_p_LD[i].begin(), _p_LD[i].end(), 0);
-        std::fill(_p_RD[i].begin(), _p_RD[i].end(), 0);
+int TextureAnalysis::ValidLevels(int Ng) {
+    if (Ng > max_levels) {
+        std::cerr << "Invalid Ng assignment (at most " << max_levels << " gray levels)!\n";
+        return max_levels;
     }
-
-    _pixel_values.clear();
-    _pixel_values_mean = std::numeric_limits<double>::quiet_NaN();
-    _pixel_values_STD = std::numeric_limits<double>::quiet_NaN();
-
-    // reset probability vectors as zeros
-    std::fill(_px_H.begin(), _px_H.end(), 0);
-    std::fill(_px_V.begin(), _px_V.end(), 0);
-    std::fill(_px_LD.begin(), _px_LD.end(), 0);
-    std::fill(_px_RD.begin(), _px_RD.end(), 0);
-
-    std::fill(_py_H.begin(), _py_H.end(), 0);
-    std::fill(_py_V.begin(), _py_V.end(), 0);
-    std::fill(_py_LD.begin(), _py_LD.end(), 0);
-    std::fill(_py_RD.begin(), _py_RD.end(), 0);
-
-    std::fill(_p_xpy_H.begin(), _p_xpy_H.end(), 0);
-    std::fill(_p_xpy_V.begin(), _p_xpy_V.end(), 0);
-    std::fill(_p_xpy_LD.begin(), _p_xpy_LD.end(), 0);
-    std::fill(_p_xpy_RD.begin(), _p_xpy_RD.end(), 0);
-
-    std::fill(_p_xny_H.begin(), _p_xny_H.end(), 0);
-    std::fill(_p_xny_V.begin(), _p_xny_V.end(), 0);
-    std::fill(_p_xny_LD.begin(), _p_xny_LD.end(), 0);
-    std::fill(_p_xny_RD.begin(), _p_xny_RD.end(), 0);
-
-    // reset factors as zeros
-    ResetFactors();
+    return Ng;
 }
 
-void TextureAnalysis::ResetFactors() {
-    // reset normalization factors as zeros
-    _R_H = 0;
-    _R_V = 0;
-    _R_LD = 0;
-    _R_RD = 0;
-
-    // initialize entropy factors
-    _HX_H = 0;
-    _HX_V = 0;
-    _HX_LD = 0;
-    _HX_RD = 0;
-
-    _HY_H = 0;
-    _HY_V = 0;
-    _HY_LD = 0;
-    _HY_RD = 0;
-
-    _HXY_H = 0;
-    _HXY_V = 0;
-    _HXY_LD = 0;
-    _HXY_RD = 0;
-
-    _HXY1_H = 0;
-    _HXY1_V = 0;
-    _HXY1_LD = 0;
-    _HXY1_RD = 0;
+void TextureAnalysis::SetNumThreads(int num_threads) {
+    if (num_threads > 0) {
+        _num_threads = num_threads;
+    } else {
+        _num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+}
 
-    _HXY2_H = 0;
-    _HXY2_V = 0;
-    _HXY2_LD = 0;
-    _HXY2_RD = 0;
+void TextureAnalysis::SetQuantization(Quantization quantization) {
+    _quantization = quantization;
 }
 
-void TextureAnalysis::CountElemH(int i, int j) {
-    ++_P_H[i][j];
-    ++_R_H;
+void TextureAnalysis::SetBinWidth(double bin_width) {
+    if (bin_width > 0) {
+        _bin_width = bin_width;
+    } else {
+        std::cerr << "Invalid bin width assignment (bin width <= 0)!\n";
+    }
 }
 
-void TextureAnalysis::CountElemV(int i, int j) {
-    ++_P_V[i][j];
-    ++_R_V;
+void TextureAnalysis::SetPercentiles(double lower, double upper) {
+    if ((lower >= 0) && (lower < upper) && (upper <= 100)) {
+        _lower_percentile = lower;
+        _upper_percentile = upper;
+    } else {
+        std::cerr << "Invalid percentiles assignment (0 <= lower < upper <= 100)!\n";
+    }
 }
 
-void TextureAnalysis::CountElemLD(int i, int j) {
-    ++_P_LD[i][j];
-    ++_R_LD;
+void TextureAnalysis::SetWindow(double level, double width) {
+    if (width > 0) {
+        _window_level = level;
+        _window_width = width;
+    } else {
+        std::cerr << "Invalid window assignment (width <= 0)!\n";
+    }
 }
 
-void TextureAnalysis::CountElemRD(int i, int j) {
-    ++_P_RD[i][j];
-    ++_R_RD;
+void TextureAnalysis::SetSymmetric(bool symmetric) {
+    _symmetric_mode = symmetric;
 }
 
-void TextureAnalysis::PushPixelValue(int pixel_value) {
-    _pixel_values.push_back((double)pixel_value);
+bool TextureAnalysis::NeedsHistogram() {
+    return (_quantization == Quantization::MinMax) || (_quantization == Quantization::Percentile);
 }
 
-void TextureAnalysis::Normalization() {
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            _p_H[i][j] = (double)_P_H[i][j] / (double)_R_H;
-            _p_V[i][j] = (double)_P_V[i][j] / (double)_R_V;
-            _p_LD[i][j] = (double)_P_LD[i][j] / (double)_R_LD;
-            _p_RD[i][j] = (double)_P_RD[i][j] / (double)_R_RD;
+void TextureAnalysis::CountRectHistogram(const cv::Mat& image, std::vector<long>& histogram) {
+    histogram.assign(256, 0);
+    for (int m = 0; m < image.rows; ++m) {
+        const uchar* row = image.ptr<uchar>(m);
+        for (int n = 0; n < image.cols; ++n) {
+            ++histogram[row[n]];
         }
     }
-
-    // calculate probability vectors
-    Calculate_px();
-    Calculate_py();
-    Calculate_p_xpy();
-    Calculate_p_xny();
-
-    // calculate pixels mean and STD in the region
-    CalculatePixelSTD(_pixel_values);
 }
 
-void TextureAnalysis::Calculate_px() {
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            _px_H[i] += _p_H[i][j];
-            _px_V[i] += _p_V[i][j];
-            _px_LD[i] += _p_LD[i][j];
-            _px_RD[i] += _p_RD[i][j];
+void TextureAnalysis::CountSpansHistogram(const cv::Mat& image, std::vector<long>& histogram) {
+    histogram.assign(256, 0);
+    for (const Span& span : _spans) {
+        const uchar* row = image.ptr<uchar>(span.row);
+        for (int l = span.begin; l < span.end; ++l) {
+            ++histogram[row[l]];
         }
     }
 }
 
-void TextureAnalysis::Calculate_py() {
-    for (int j = 0; j < _Ng; ++j) {
-        for (int i = 0; i < _Ng; ++i) {
-            _py_H[j] += _p_H[i][j];
-            _py_V[j] += _p_V[i][j];
-            _py_LD[j] += _p_LD[i][j];
-            _py_RD[j] += _p_RD[i][j];
+void TextureAnalysis::BuildLevels(const std::vector<long>& histogram) {
+    // [low, high] pixel value range rescaled to the gray levels for the min/max and percentile modes
+    int low = 0;
+    int high = 255;
+    if (NeedsHistogram()) {
+        long num_pixels = 0;
+        for (long count : histogram) {
+            num_pixels += count;
+        }
+        double lower = (_quantization == Quantization::Percentile) ? _lower_percentile : 0.0;
+        double upper = (_quantization == Quantization::Percentile) ? _upper_percentile : 100.0;
+
+        // smallest values having at least the lower/upper fraction of the region at or below them
+        long cumulative = 0;
+        low = -1;
+        high = -1;
+        for (int v = 0; v < 256; ++v) {
+            cumulative += histogram[v];
+            if (cumulative == 0) {
+                continue;
+            }
+            if ((low < 0) && (cumulative >= lower / 100.0 * num_pixels)) {
+                low = v;
+            }
+            if ((high < 0) && (cumulative >= upper / 100.0 * num_pixels)) {
+                high = v;
+            }
+        }
+        if (low < 0) { // empty region
+            low = 0;
+            high = 255;
+        }
+    }
+
+    for (int v = 0; v < 256; ++v) {
+        int level;
+        switch (_quantization) {
+            case Quantization::Uniform:
+                level = v * _Ng / 256;
+                break;
+            case Quantization::FixedBinWidth:
+                level = (int)floor(v / _bin_width);
+                break;
+            case Quantization::MinMax:
+            case Quantization::Percentile:
+                level = (int)floor((double)(v - low) * _Ng / (high - low + 1));
+                break;
+            case Quantization::Window:
+                level = (int)floor((v - (_window_level - _window_width / 2)) * _Ng / _window_width);
+                break;
+            default:
+                level = v;
+                break;
         }
+        _levels[v] = (uchar)std::min(std::max(level, 0), _Ng - 1);
     }
 }
 
-void TextureAnalysis::Calculate_p_xpy() {
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            int k = i + j;
-            _p_xpy_H[k] += _p_H[i][j];
-            _p_xpy_V[k] += _p_V[i][j];
-            _p_xpy_LD[k] += _p_LD[i][j];
-            _p_xpy_RD[k] += _p_RD[i][j];
+template <typename T, typename Function>
+void TextureAnalysis::ForEachRegionValue(const cv::Mat& image, bool polygon, Function function) {
+    auto visit = [&](int row, int begin, int end) {
+        const T* pixels = image.ptr<T>(row);
+        for (int n = begin; n < end; ++n) {
+            if (!std::isnan((double)pixels[n])) {
+                function((double)pixels[n]);
+            }
+        }
+    };
+    if (polygon) {
+        for (const Span& span : _spans) {
+            visit(span.row, span.begin, span.end);
+        }
+    } else {
+        for (int m = 0; m < image.rows; ++m) {
+            visit(m, 0, image.cols);
         }
     }
 }
 
-void TextureAnalysis::Calculate_p_xny() {
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            int k = abs(i - j);
-            _p_xny_H[k] += _p_H[i][j];
-            _p_xny_V[k] += _p_V[i][j];
-            _p_xny_LD[k] += _p_LD[i][j];
-            _p_xny_RD[k] += _p_RD[i][j];
+template <typename T>
+void TextureAnalysis::BuildLevelMap(const cv::Mat& image, bool polygon) {
+    // The same formulas as BuildLevels() on the pixel values, with the [low, high] range of the region found by a pass over it for the
+    // min/max and percentile modes. The integer values keep the (high - low + 1) bins of the 8-bit table, the floating-point ones
+    // rescale [low, high] itself.
+    constexpr bool integer = std::is_integral<T>::value;
+    _level_map = {0.0, 1.0, 1.0, _Ng - 1};
+    switch (_quantization) {
+        case Quantization::Uniform:
+            _level_map.factor = _Ng;
+            _level_map.width = integer ? 65536.0 : 1.0;
+            return;
+        case Quantization::FixedBinWidth:
+            _level_map.width = _bin_width;
+            return;
+        case Quantization::Window:
+            _level_map.low = _window_level - _window_width / 2;
+            _level_map.factor = _Ng;
+            _level_map.width = _window_width;
+            return;
+        case Quantization::MinMax:
+        case Quantization::Percentile:
+            break;
+        default:
+            return;
+    }
+
+    long num_pixels = 0;
+    double low = std::numeric_limits<double>::infinity();
+    double high = -std::numeric_limits<double>::infinity();
+    ForEachRegionValue<T>(image, polygon, [&](double value) {
+        ++num_pixels;
+        low = std::min(low, value);
+        high = std::max(high, value);
+    });
+    if (num_pixels == 0) { // empty region
+        return;
+    }
+
+    if (_quantization == Quantization::Percentile) {
+        // Smallest values having at least the lower/upper fraction of the region at or below them, from a histogram of 65536 bins over
+        // [low, high]. The 16-bit values get a bin each and are exact, the others are found to 1/65536 of the range.
+        const int num_bins = 65536;
+        double bin_width = (integer || (high == low)) ? 1.0 : (high - low) / num_bins;
+        std::vector<long> histogram(num_bins, 0);
+        ForEachRegionValue<T>(image, polygon, [&](double value) {
+            ++histogram[std::min((int)((value - low) / bin_width), num_bins - 1)];
+        });
+        long cumulative = 0;
+        int lower_bin = -1;
+        int upper_bin = -1;
+        for (int bin = 0; bin < num_bins; ++bin) {
+            cumulative += histogram[bin];
+            if (cumulative == 0) {
+                continue;
+            }
+            if ((lower_bin < 0) && (cumulative >= _lower_percentile / 100.0 * num_pixels)) {
+                lower_bin = bin;
+            }
+            if ((upper_bin < 0) && (cumulative >= _upper_percentile / 100.0 * num_pixels)) {
+                upper_bin = bin;
+            }
         }
+        double base = low;
+        low = base + lower_bin * bin_width;
+        high = base + (upper_bin + 1) * bin_width - (integer ? 1.0 : 0.0);
+    }
+
+    _level_map.low = low;
+    _level_map.factor = _Ng;
+    _level_map.width = integer ? (high - low + 1) : (high - low);
+    if (_level_map.width <= 0) { // a single value
+        _level_map.factor = 0.0;
+        _level_map.width = 1.0;
     }
 }
 
-double TextureAnalysis::CalculateMean(const std::vector<double>& vec) {
-    double sum = 0.0;
-    for (int i = 0; i < vec.size(); ++i) {
-        sum += i * vec[i];
+bool TextureAnalysis::CheckDistance(int distance) {
+    if (distance < 1) {
+        std::cerr << "Invalid distance assignment (distance < 1)!\n";
+        return false;
     }
-    return sum;
+    return true;
 }
 
-double TextureAnalysis::CalculateSTD(const std::vector<double>& vec) {
-    double mean = CalculateMean(vec);
-    double sum = 0.0;
-    for (int i = 0; i < vec.size(); ++i) {
-        sum += (i - mean) * (i - mean) * vec[i];
+bool TextureAnalysis::CheckImage(const cv::Mat& image) {
+    int depth = image.depth();
+    if ((image.channels() != 1) || ((depth != CV_8U) && (depth != CV_16U) && (depth != CV_32F) && (depth != CV_64F))) {
+        std::cerr << "Invalid image type (CV_8UC1, CV_16UC1, CV_32FC1 or CV_64FC1)!\n";
+        return false;
     }
-    return sqrt(sum);
+    return true;
 }
 
-double TextureAnalysis::CalculateGLCMMean_i(const std::vector<std::vector<double>>& mat) {
-    double mean = 0.0;
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            mean += i * mat[i][j];
-        }
+bool TextureAnalysis::UseSparse(long counts_per_direction) {
+    // the callers pass the counts of a direction, every pair counted in both orders
+    return counts_per_direction * sparse_cells_per_pair < (long)_Ng * _Ng;
+}
+
+int TextureAnalysis::CountBands(int num_rows, long num_pixels) {
+    // every thread zeroes and reduces its own Ng x Ng matrices, so small regions are not worth splitting
+    long max_bands = std::max(1L, num_pixels / min_pixels_per_band);
+    return (int)std::max(1L, std::min({(long)_num_threads, (long)num_rows, max_bands}));
+}
+
+void TextureAnalysis::AccumulateBands(int num_bands, const std::function<void(int, Partial&)>& accumulate) {
+    PreparePartials(num_bands);
+    RunBands(num_bands, [&](int band) {
+        _partials[band].Reset(_Ng, _sparse, _symmetric);
+        accumulate(band, _partials[band]);
+    });
+    ReducePartials(num_bands);
+}
+
+void TextureAnalysis::PreparePartials(int num_bands) {
+    if (_partials.size() < num_bands) {
+        _partials.resize(num_bands);
     }
-    return mean;
 }
 
-double TextureAnalysis::CalculateGLCMMean_j(const std::vector<std::vector<double>>& mat) {
-    double mean = 0.0;
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            mean += j * mat[i][j];
-        }
+void TextureAnalysis::RunBands(int num_bands, const std::function<void(int)>& run_band) {
+    std::vector<std::thread> threads;
+    for (int band = 1; band < num_bands; ++band) {
+        threads.emplace_back(run_band, band);
+    }
+    run_band(0);
+    for (auto& thread : threads) {
+        thread.join();
     }
-    return mean;
 }
 
-double TextureAnalysis::CalculateGLCMSTD_i(const std::vector<std::vector<double>>& mat) {
-    double mu_x = CalculateGLCMMean_i(mat);
-    double sigma_x = 0.0;
+void TextureAnalysis::ReducePartials(int num_bands) {
+    for (int band = 0; band < num_bands; ++band) {
+        Partial& partial = _partials[band];
+        if (_sparse) {
+            _pairs.insert(_pairs.end(), partial.pairs.begin(), partial.pairs.end());
+        } else if (band == 0) {
+            // the first band takes the place of the zeroed matrices, the zeros are handed back to be reset on the next run
+            std::swap(_P, partial.P);
+            _range = partial.levels;
+            partial.levels = {_Ng, 0};
+        } else {
+            // only the occupied block of the band holds counts
+            for (int i = partial.levels.begin; i < partial.levels.end; ++i) {
+                int* P = _P.Cell(i, partial.levels.begin);
+                const int* P_band = partial.P.Cell(i, partial.levels.begin);
+                for (int k = 0; k < (partial.levels.end - partial.levels.begin) * num_directions; ++k) {
+                    P[k] += P_band[k];
+                }
+            }
+            _range.begin = std::min(_range.begin, partial.levels.begin);
+            _range.end = std::max(_range.end, partial.levels.end);
+        }
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            sigma_x += (i - mu_x) * (i - mu_x) * mat[i][j];
+        _R_H += partial.R_H;
+        _R_V += partial.R_V;
+        _R_LD += partial.R_LD;
+        _R_RD += partial.R_RD;
+
+        for (int v = 0; v < 256; ++v) {
+            _histogram[v] += partial.histogram[v];
         }
     }
 
-    return sqrt(sigma_x);
+    if (_sparse) {
+        BuildSparse();
+    }
 }
 
-double TextureAnalysis::CalculateGLCMSTD_j(const std::vector<std::vector<double>>& mat) {
-    double mu_y = CalculateGLCMMean_j(mat);
-    double sigma_y = 0.0;
+void TextureAnalysis::BuildSparse() {
+    // sorting the pairs groups them per cell in row-major order, with the directions of a cell next to each other
+    std::sort(_pairs.begin(), _pairs.end());
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            sigma_y += (j - mu_y) * (j - mu_y) * mat[i][j];
+    _sparse_P.Clear();
+    _range = {_Ng, 0};
+    for (std::size_t k = 0; k < _pairs.size(); ++k) {
+        unsigned cell = _pairs[k] >> 2;
+        if ((k == 0) || (cell != (_pairs[k - 1] >> 2))) {
+            int i = (int)cell / _Ng;
+            int j = (int)cell % _Ng;
+            _sparse_P.rows.push_back(i);
+            _sparse_P.cols.push_back(j);
+            _sparse_P.counts.insert(_sparse_P.counts.end(), num_directions, 0);
+            _range.begin = std::min({_range.begin, i, j});
+            _range.end = std::max({_range.end, i + 1, j + 1});
         }
+        // a symmetric pair on the diagonal is that cell in both orders
+        _sparse_P.counts[(std::size_t)(_sparse_P.Size() - 1) * num_directions + (_pairs[k] & 3)] +=
+            (_symmetric && ((int)cell / _Ng == (int)cell % _Ng)) ? 2 : 1;
     }
+}
 
-    return sqrt(sigma_y);
+void TextureAnalysis::ScatterSparseCounts() {
+    for (int e = 0; e < _sparse_P.Size(); ++e) {
+        std::copy_n(&_sparse_P.counts[(std::size_t)e * num_directions], num_directions, _P.Cell(_sparse_P.rows[e], _sparse_P.cols[e]));
+    }
+    _sparse = false;
 }
 
-void TextureAnalysis::CalculateHX() {
-    for (int i = 0; i < _Ng; ++i) {
-        if (_px_H[i] > 0) {
-            _HX_H -= _px_H[i] * log(_px_H[i]);
-        }
-        if (_px_V[i] > 0) {
-            _HX_V -= _px_V[i] * log(_px_V[i]);
+void TextureAnalysis::MirrorUpperTriangle() {
+    for (int i = _range.begin; i < _range.end; ++i) {
+        for (int j = i + 1; j < _range.end; ++j) {
+            std::copy_n(_P.Cell(i, j), num_directions, _P.Cell(j, i));
         }
-        if (_px_LD[i] > 0) {
-            _HX_LD -= _px_LD[i] * log(_px_LD[i]);
+    }
+    _symmetric = false;
+}
+
+const double* TextureAnalysis::DenseP() {
+    if (!_normalized) {
+        if (_sparse) {
+            ScatterSparseCounts();
         }
-        if (_px_RD[i] > 0) {
-            _HX_RD -= _px_RD[i] * log(_px_RD[i]);
+        if (_symmetric) {
+            MirrorUpperTriangle();
         }
+        double R[num_directions] = {(double)_R_H, (double)_R_V, (double)_R_LD, (double)_R_RD};
+        _kernels->normalize(_P.Data(), _Ng, _range, false, R, _p.Data());
+        _normalized = true;
     }
+    return _p.Data();
 }
 
-void TextureAnalysis::CalculateHY() {
-    for (int i = 0; i < _Ng; ++i) {
-        if (_py_H[i] > 0) {
-            _HY_H -= _py_H[i] * log(_py_H[i]);
+void TextureAnalysis::AccumulateRect(const cv::Mat& image, int distance, int row_begin, int row_end, Partial& partial) {
+    AccumulateRectRows(image, distance, row_begin, row_end, partial);
+    TrackRectLevels(image, distance, row_end, partial);
+}
+
+void TextureAnalysis::AccumulateRectRows(const cv::Mat& image, int distance, int row_begin, int row_end, Partial& partial) {
+    // Every pixel pair (m, n) - (m + dm, n + dn) with the offsets (0, d), (d, 0), (d, d) and (d, -d) is visited once and counted in
+    // both orders, which gives the same symmetric counts as scanning the (2d + 1) x (2d + 1) neighborhood of every pixel for the
+    // offsets +/-d; in the symmetric mode both orders go to the one cell of the upper triangle. Row pointers are used instead of at<>()
+    // since the crop may not be continuous. A band owns the pairs starting in its rows [row_begin, row_end) and only reads the d rows
+    // below it, so every pair is counted by exactly one band.
+    const uchar* level = _levels.data();
+    for (int m = row_begin; m < row_end; ++m) {
+        const uchar* row = image.ptr<uchar>(m);
+
+        for (int n = 0; n < image.cols; ++n) {
+            partial.CountPixel(row[n]);
+        }
+
+        // 0 degree: (m, n) - (m, n + d)
+        for (int n = 0; n + distance < image.cols; ++n) {
+            partial.CountPairH(level[row[n]], level[row[n + distance]]);
         }
-        if (_py_V[i] > 0) {
-            _HY_V -= _py_V[i] * log(_py_V[i]);
+
+        if (m + distance >= image.rows) {
+            continue;
         }
-        if (_py_LD[i] > 0) {
-            _HY_LD -= _py_LD[i] * log(_py_LD[i]);
+        const uchar* row_below = image.ptr<uchar>(m + distance);
+
+        // 90 degree: (m, n) - (m + d, n)
+        for (int n = 0; n < image.cols; ++n) {
+            partial.CountPairV(level[row[n]], level[row_below[n]]);
         }
-        if (_py_RD[i] > 0) {
-            _HY_RD -= _py_RD[i] * log(_py_RD[i]);
+
+        // 135 degree: (m, n) - (m + d, n + d)
+        for (int n = 0; n + distance < image.cols; ++n) {
+            partial.CountPairLD(level[row[n]], level[row_below[n + distance]]);
+        }
+
+        // 45 degree: (m, n) - (m + d, n - d)
+        for (int n = distance; n < image.cols; ++n) {
+            partial.CountPairRD(level[row[n]], level[row_below[n - distance]]);
         }
     }
 }
 
-void TextureAnalysis::CalculateHXY() {
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            if (_p_H[i][j] > 0) {
-                _HXY_H -= _p_H[i][j] * log(_p_H[i][j]);
-            }
-            if (_p_V[i][j] > 0) {
-                _HXY_V -= _p_V[i][j] * log(_p_V[i][j]);
-            }
-            if (_p_LD[i][j] > 0) {
-                _HXY_LD -= _p_LD[i][j] * log(_p_LD[i][j]);
+void TextureAnalysis::TrackRectLevels(const cv::Mat& image, int distance, int row_end, Partial& partial) {
+    // the levels of the band are those of its pixel values, and the pairs of the last rows reach the d rows below it
+    const uchar* level = _levels.data();
+    for (int v = 0; v < 256; ++v) {
+        if (partial.histogram[v] > 0) {
+            partial.TrackLevel(level[v]);
+        }
+    }
+    for (int m = row_end; m < std::min(row_end + distance, image.rows); ++m) {
+        partial.TrackLevels(level, image.ptr<uchar>(m), 0, image.cols);
+    }
+}
+
+void TextureAnalysis::AccumulateRectOffsets(const cv::Mat& image, const Offset* offsets, int row_begin, int row_end, Partial& partial) {
+    // As AccumulateRectRows: every pair (m, n) - (m + dy, n + dx) is counted in both orders by the band owning the row m
+    const uchar* level = _levels.data();
+    for (int m = row_begin; m < row_end; ++m) {
+        const uchar* row = image.ptr<uchar>(m);
+
+        for (int n = 0; n < image.cols; ++n) {
+            partial.CountPixel(row[n]);
+        }
+
+        for (int k = 0; k < num_directions; ++k) {
+            int dy = offsets[k].dy;
+            int dx = offsets[k].dx;
+            if (((dy == 0) && (dx == 0)) || (m + dy >= image.rows)) {
+                continue;
             }
-            if (_p_RD[i][j] > 0) {
-                _HXY_RD -= _p_RD[i][j] * log(_p_RD[i][j]);
+            const uchar* row_other = image.ptr<uchar>(m + dy);
+            int n_begin = std::max(0, -dx);
+            int n_end = std::min(image.cols, image.cols - dx);
+            for (int n = n_begin; n < n_end; ++n) {
+                partial.CountPair(level[row[n]], level[row_other[n + dx]], k);
             }
+            partial.AddPairs(k, 2 * std::max(0, n_end - n_begin));
         }
     }
 }
 
-void TextureAnalysis::CalculateHXY1() {
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            if (_px_H[i] * _py_H[j] > 0) {
-                _HXY1_H -= _p_H[i][j] * log(_px_H[i] * _py_H[j]);
+template <typename T>
+void TextureAnalysis::AccumulateRectWide(const cv::Mat& image, int distance, int row_begin, int row_end, Partial& partial) {
+    // As AccumulateRectRows, on the levels of a ring of d + 1 quantized rows: every row is mapped once, when the pairs first reach it,
+    // and the rows of the band with the d rows below it give its level range. A NaN pixel has the level -1 and neither it nor its
+    // pairs are counted, so the pair totals only hold the counted pairs.
+    int cols = image.cols;
+    std::vector<int> ring((std::size_t)(distance + 1) * cols);
+    auto levels_of = [&](int m) { return ring.data() + (std::size_t)(m % (distance + 1)) * cols; };
+    auto quantize = [&](int m) {
+        const T* pixels = image.ptr<T>(m);
+        int* levels = levels_of(m);
+        for (int n = 0; n < cols; ++n) {
+            levels[n] = _level_map((double)pixels[n]);
+            if (levels[n] >= 0) {
+                partial.TrackLevel(levels[n]);
             }
-            if (_px_V[i] * _py_V[j] > 0) {
-                _HXY1_V -= _p_V[i][j] * log(_px_V[i] * _py_V[j]);
-            }
-            if (_px_LD[i] * _py_LD[j] > 0) {
-                _HXY1_LD -= _p_LD[i][j] * log(_px_LD[i] * _py_LD[j]);
+        }
+    };
+    for (int m = row_begin; m < std::min(row_begin + distance, image.rows); ++m) {
+        quantize(m);
+    }
+
+    // the pairs of (m, n) towards (m + dm, n + dn), with the NaN-free ones counted in both orders
+    auto count_pairs = [&](const int* levels, const int* levels_other, int n_begin, int n_end, int dn, int direction) {
+        int num_pairs = 0;
+        for (int n = n_begin; n < n_end; ++n) {
+            int a = levels[n];
+            int b = levels_other[n + dn];
+            if ((a | b) >= 0) {
+                partial.CountPair(a, b, direction);
+                num_pairs += 2;
             }
-            if (_px_RD[i] * _py_RD[j] > 0) {
-                _HXY1_RD -= _p_RD[i][j] * log(_px_RD[i] * _py_RD[j]);
+        }
+        partial.AddPairs(direction, num_pairs);
+    };
+
+    for (int m = row_begin; m < row_end; ++m) {
+        if (m + distance < image.rows) {
+            quantize(m + distance); // takes the place of the row m - 1
+        }
+        const int* levels = levels_of(m);
+
+        for (int n = 0; n < cols; ++n) {
+            if (levels[n] >= 0) {
+                partial.CountPixel(levels[n]);
             }
         }
+
+        count_pairs(levels, levels, 0, cols - distance, distance, 0); // 0 degree
+        if (m + distance >= image.rows) {
+            continue;
+        }
+        const int* levels_below = levels_of(m + distance);
+        count_pairs(levels, levels_below, 0, cols, 0, 1);                    // 90 degree
+        count_pairs(levels, levels_below, 0, cols - distance, distance, 2);  // 135 degree
+        count_pairs(levels, levels_below, distance, cols, -distance, 3);     // 45 degree
     }
 }
 
-void TextureAnalysis::CalculateHXY2() {
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            if (_px_H[i] * _py_H[j] > 0) {
-                _HXY2_H -= _px_H[i] * _py_H[j] * log(_px_H[i] * _py_H[j]);
-            }
-            if (_px_V[i] * _py_V[j] > 0) {
-                _HXY2_V -= _px_V[i] * _py_V[j] * log(_px_V[i] * _py_V[j]);
+void TextureAnalysis::ExtractMaskSpans(const cv::Mat& mask_image, const cv::Rect& bounds) {
+    _spans.clear();
+
+    cv::Rect roi = bounds & cv::Rect(0, 0, mask_image.cols, mask_image.rows);
+    for (int k = roi.y; k < roi.y + roi.height; ++k) {
+        const uchar* mask_row = mask_image.ptr<uchar>(k);
+        int l = roi.x;
+        int l_end = roi.x + roi.width;
+        while (l < l_end) {
+            while ((l < l_end) && (mask_row[l] != white_color)) {
+                ++l;
             }
-            if (_px_LD[i] * _py_LD[j] > 0) {
-                _HXY2_LD -= _px_LD[i] * _py_LD[j] * log(_px_LD[i] * _py_LD[j]);
+            int begin = l;
+            while ((l < l_end) && (mask_row[l] == white_color)) {
+                ++l;
             }
-            if (_px_RD[i] * _py_RD[j] > 0) {
-                _HXY2_RD -= _px_RD[i] * _py_RD[j] * log(_px_RD[i] * _py_RD[j]);
+            if (l > begin) {
+                _spans.push_back({k, begin, l});
             }
         }
     }
 }
 
-Features TextureAnalysis::CalculateQ(int i, int j) {
-    double Q_H = 0.0;
-    double Q_V = 0.0;
-    double Q_LD = 0.0;
-    double Q_RD = 0.0;
+void TextureAnalysis::AccumulatePolygon(const cv::Mat& image, int distance, int span_begin, int span_end, Partial& partial) {
+    // A pair is counted from its non-masked pixel (k, l) towards every neighbor (k, l) -/+ offset inside the image, whether the
+    // neighbor is masked or not, which is what the full image scan with the mask check on the neighbor pixel does
+    const uchar* level = _levels.data();
+    for (int k = span_begin; k < span_end; ++k) {
+        const Span& span = _spans[k];
+        const uchar* row = image.ptr<uchar>(span.row);
+        const uchar* row_above = (span.row - distance >= 0) ? image.ptr<uchar>(span.row - distance) : nullptr;
+        const uchar* row_below = (span.row + distance < image.rows) ? image.ptr<uchar>(span.row + distance) : nullptr;
+        int left_begin = std::max(span.begin, distance);         // columns having a neighbor at l - d
+        int right_end = std::min(span.end, image.cols - distance); // columns having a neighbor at l + d
 
-    for (int k = 0; k < _Ng; ++k) {
-        if ((_px_H[i] * _py_H[k]) != 0) {
-            Q_H += (_p_H[i][k] * _p_H[j][k]) / (_px_H[i] * _py_H[k]);
+        for (int l = span.begin; l < span.end; ++l) {
+            partial.CountPixel(row[l]);
         }
-        if ((_px_V[i] * _py_V[k]) != 0) {
-            Q_V += (_p_V[i][k] * _p_V[j][k]) / (_px_V[i] * _py_V[k]);
+
+        // the counts go from the span to the neighbors within d columns of it
+        int neighbor_begin = std::max(span.begin - distance, 0);
+        int neighbor_end = std::min(span.end + distance, image.cols);
+        partial.TrackLevels(level, row, neighbor_begin, neighbor_end);
+        if (row_above) {
+            partial.TrackLevels(level, row_above, neighbor_begin, neighbor_end);
         }
-        if ((_px_LD[i] * _py_LD[k]) != 0) {
-            Q_LD += (_p_LD[i][k] * _p_LD[j][k]) / (_px_LD[i] * _py_LD[k]);
+        if (row_below) {
+            partial.TrackLevels(level, row_below, neighbor_begin, neighbor_end);
         }
-        if ((_px_RD[i] * _py_RD[k]) != 0) {
-            Q_RD += (_p_RD[i][k] * _p_RD[j][k]) / (_px_RD[i] * _py_RD[k]);
+
+        // 0 degree
+        for (int l = left_begin; l < span.end; ++l) {
+            partial.CountElemH(level[row[l]], level[row[l - distance]]);
+        }
+        for (int l = span.begin; l < right_end; ++l) {
+            partial.CountElemH(level[row[l]], level[row[l + distance]]);
+        }
+
+        if (row_above) {
+            for (int l = span.begin; l < span.end; ++l) { // 90 degree
+                partial.CountElemV(level[row[l]], level[row_above[l]]);
+            }
+            for (int l = left_begin; l < span.end; ++l) { // 135 degree
+                partial.CountElemLD(level[row[l]], level[row_above[l - distance]]);
+            }
+            for (int l = span.begin; l < right_end; ++l) { // 45 degree
+                partial.CountElemRD(level[row[l]], level[row_above[l + distance]]);
+            }
         }
-    }
 
-    return {Q_H, Q_V, Q_LD, Q_RD};
+        if (row_below) {
+            for (int l = span.begin; l < span.end; ++l) { // 90 degree
+                partial.CountElemV(level[row[l]], level[row_below[l]]);
+            }
+            for (int l = span.begin; l < right_end; ++l) { // 135 degree
+                partial.CountElemLD(level[row[l]], level[row_below[l + distance]]);
+            }
+            for (int l = left_begin; l < span.end; ++l) { // 45 degree
+                partial.CountElemRD(level[row[l]], level[row_below[l - distance]]);
+            }
+        }
+    }
 }
 
-//===============================================================================================================
-// Calculate texture feature coefficients
-//===============================================================================================================
+void TextureAnalysis::AccumulatePolygonOffsets(const cv::Mat& image, const Offset* offsets, int span_begin, int span_end,
+    Partial& partial) {
+    // As AccumulatePolygon: a pair is counted from its non-masked pixel towards both neighbors (k, l) +/- offset inside the image
+    const uchar* level = _levels.data();
+    for (int s = span_begin; s < span_end; ++s) {
+        const Span& span = _spans[s];
+        const uchar* row = image.ptr<uchar>(span.row);
 
-void TextureAnalysis::GetEnergy(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+        for (int l = span.begin; l < span.end; ++l) {
+            partial.CountPixel(row[l]);
+        }
+        partial.TrackLevels(level, row, span.begin, span.end);
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += _p_H[i][j] * _p_H[i][j];
-            f_V += _p_V[i][j] * _p_V[i][j];
-            f_LD += _p_LD[i][j] * _p_LD[i][j];
-            f_RD += _p_RD[i][j] * _p_RD[i][j];
+        for (int k = 0; k < num_directions; ++k) {
+            if ((offsets[k].dy == 0) && (offsets[k].dx == 0)) {
+                continue;
+            }
+            for (int sign : {1, -1}) {
+                int dy = sign * offsets[k].dy;
+                int dx = sign * offsets[k].dx;
+                if ((span.row + dy < 0) || (span.row + dy >= image.rows)) {
+                    continue;
+                }
+                const uchar* row_other = image.ptr<uchar>(span.row + dy);
+                int l_begin = std::max(span.begin, -dx);
+                int l_end = std::min(span.end, image.cols - dx);
+                if (l_begin >= l_end) {
+                    continue;
+                }
+                partial.TrackLevels(level, row_other, l_begin + dx, l_end + dx);
+                for (int l = l_begin; l < l_end; ++l) {
+                    partial.Count(level[row[l]], level[row_other[l + dx]], k);
+                }
+                partial.AddPairs(k, l_end - l_begin);
+            }
         }
     }
-
-    f(f_H, f_V, f_LD, f_RD);
 }
 
-void TextureAnalysis::GetContrast(Features& f) {
-    std::vector<double> sub_H(_Ng);
-    std::vector<double> sub_V(_Ng);
-    std::vector<double> sub_LD(_Ng);
-    std::vector<double> sub_RD(_Ng);
+template <typename T>
+void TextureAnalysis::AccumulatePolygonWide(const cv::Mat& image, int distance, int span_begin, int span_end, Partial& partial) {
+    // As AccumulatePolygon, on the levels of the span row and the rows d above and below it over the columns within d of the span.
+    // A NaN pixel has the level -1 and neither it nor its pairs are counted.
+    std::vector<int> buffer;
+    for (int s = span_begin; s < span_end; ++s) {
+        const Span& span = _spans[s];
+        int column_begin = std::max(span.begin - distance, 0);
+        int column_end = std::min(span.end + distance, image.cols);
+        int width = column_end - column_begin;
+
+        // levels[1 + dm / d] holds the row span.row + dm, or nullptr outside the image, indexed by the column
+        buffer.resize((std::size_t)3 * width);
+        const int* levels[3];
+        for (int k = 0; k < 3; ++k) {
+            int row = span.row + (k - 1) * distance;
+            if ((row < 0) || (row >= image.rows)) {
+                levels[k] = nullptr;
+                continue;
+            }
+            const T* pixels = image.ptr<T>(row);
+            int* row_levels = buffer.data() + (std::size_t)k * width;
+            for (int l = column_begin; l < column_end; ++l) {
+                row_levels[l - column_begin] = _level_map((double)pixels[l]);
+                if (row_levels[l - column_begin] >= 0) {
+                    partial.TrackLevel(row_levels[l - column_begin]);
+                }
+            }
+            levels[k] = row_levels - column_begin;
+        }
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            int n = abs(i - j);
-            sub_H[n] += _p_H[i][j];
-            sub_V[n] += _p_V[i][j];
-            sub_LD[n] += _p_LD[i][j];
-            sub_RD[n] += _p_RD[i][j];
+        const int* row_levels = levels[1];
+        for (int l = span.begin; l < span.end; ++l) {
+            if (row_levels[l] >= 0) {
+                partial.CountPixel(row_levels[l]);
+            }
         }
-    }
 
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+        // the neighbors (dm, dn) of every direction, counted from the span towards them
+        const int neighbors[8][3] = {{0, -1, 0}, {0, 1, 0}, {-1, 0, 1}, {1, 0, 1}, {-1, -1, 2}, {1, 1, 2}, {-1, 1, 3}, {1, -1, 3}};
+        for (const auto& neighbor : neighbors) {
+            const int* neighbor_levels = levels[1 + neighbor[0]];
+            if (!neighbor_levels) {
+                continue;
+            }
+            int dn = neighbor[1] * distance;
+            int l_begin = std::max(span.begin, -dn);
+            int l_end = std::min(span.end, image.cols - dn);
+            int num_pairs = 0;
+            for (int l = l_begin; l < l_end; ++l) {
+                int i = row_levels[l];
+                int j = neighbor_levels[l + dn];
+                if ((i | j) >= 0) {
+                    partial.Count(i, j, neighbor[2]);
+                    ++num_pairs;
+                }
+            }
+            partial.AddPairs(neighbor[2], num_pairs);
+        }
+    }
+}
 
-    for (int n = 0; n < _Ng; ++n) {
-        f_H += (n * n) * sub_H[n];
-        f_V += (n * n) * sub_V[n];
-        f_LD += (n * n) * sub_LD[n];
-        f_RD += (n * n) * sub_RD[n];
+void TextureAnalysis::ResetCache() {
+    // reset the matrices as zeros, only the block written by the last run is not zero
+    if (!_sparse) {
+        _P.FillBlock(_range.begin, _range.end, 0);
+    }
+    if (_normalized) {
+        _p.FillBlock(_range.begin, _range.end, 0.0);
     }
+    _range = {_Ng, 0};
+    _normalized = false;
+    _symmetric = false;
+    _sparse = false;
+    _sparse_P.Clear();
+    _pairs.clear();
 
-    f(f_H, f_V, f_LD, f_RD);
-}
+    std::fill(_histogram.begin(), _histogram.end(), 0);
+    _pixel_values_mean = std::numeric_limits<double>::quiet_NaN();
+    _pixel_values_STD = std::numeric_limits<double>::quiet_NaN();
+    _pixel_values_skewness = std::numeric_limits<double>::quiet_NaN();
+    _pixel_values_kurtosis = std::numeric_limits<double>::quiet_NaN();
+    _pixel_values_energy = std::numeric_limits<double>::quiet_NaN();
+    _pixel_values_entropy = std::numeric_limits<double>::quiet_NaN();
 
-void TextureAnalysis::GetContrastAnotherWay(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+    // reset probability vectors as zeros
+    std::fill(_px_H.begin(), _px_H.end(), 0);
+    std::fill(_px_V.begin(), _px_V.end(), 0);
+    std::fill(_px_LD.begin(), _px_LD.end(), 0);
+    std::fill(_px_RD.begin(), _px_RD.end(), 0);
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += (i - j) * (i - j) * _p_H[i][j];
-            f_V += (i - j) * (i - j) * _p_V[i][j];
-            f_LD += (i - j) * (i - j) * _p_LD[i][j];
-            f_RD += (i - j) * (i - j) * _p_RD[i][j];
+    std::fill(_py_H.begin(), _py_H.end(), 0);
+    std::fill(_py_V.begin(), _py_V.end(), 0);
+    std::fill(_py_LD.begin(), _py_LD.end(), 0);
+    std::fill(_py_RD.begin(), _py_RD.end(), 0);
+
+    std::fill(_p_xpy_H.begin(), _p_xpy_H.end(), 0);
+    std::fill(_p_xpy_V.begin(), _p_xpy_V.end(), 0);
+    std::fill(_p_xpy_LD.begin(), _p_xpy_LD.end(), 0);
+    std::fill(_p_xpy_RD.begin(), _p_xpy_RD.end(), 0);
+
+    std::fill(_p_xny_H.begin(), _p_xny_H.end(), 0);
+    std::fill(_p_xny_V.begin(), _p_xny_V.end(), 0);
+    std::fill(_p_xny_LD.begin(), _p_xny_LD.end(), 0);
+    std::fill(_p_xny_RD.begin(), _p_xny_RD.end(), 0);
+
+    // reset factors as zeros
+    ResetFactors();
+}
+
+void TextureAnalysis::Partial::Reset(int Ng_, bool sparse_, bool symmetric_) {
+    Ng = Ng_;
+    sparse = sparse_;
+    symmetric = symmetric_;
+    if (sparse) {
+        // P is left as it is, "levels" keeps covering its non-zero block
+        pairs.clear();
+    } else {
+        if (P.Ng() != Ng) {
+            P.Resize(Ng);
+        } else {
+            P.FillBlock(levels.begin, levels.end, 0);
         }
+        levels = {Ng, 0};
     }
 
-    f(f_H, f_V, f_LD, f_RD);
+    R_H = 0;
+    R_V = 0;
+    R_LD = 0;
+    R_RD = 0;
+
+    histogram.assign(256, 0);
 }
 
-void TextureAnalysis::GetCorrelationI(Features& f) {
-    // Calculate means
-    double mu_x_H = CalculateMean(_px_H);
-    double mu_x_V = CalculateMean(_px_V);
-    double mu_x_LD = CalculateMean(_px_LD);
-    double mu_x_RD = CalculateMean(_px_RD);
-
-    double mu_y_H = CalculateMean(_py_H);
-    double mu_y_V = CalculateMean(_py_V);
-    double mu_y_LD = CalculateMean(_py_LD);
-    double mu_y_RD = CalculateMean(_py_RD);
-
-    // Calculate STDs
-    double sigma_x_H = CalculateSTD(_px_H);
-    double sigma_x_V = CalculateSTD(_px_V);
-    double sigma_x_LD = CalculateSTD(_px_LD);
-    double sigma_x_RD = CalculateSTD(_px_RD);
-
-    double sigma_y_H = CalculateSTD(_py_H);
-    double sigma_y_V = CalculateSTD(_py_V);
-    double sigma_y_LD = CalculateSTD(_py_LD);
-    double sigma_y_RD = CalculateSTD(_py_RD);
+void TextureAnalysis::ResetFactors() {
+    // reset normalization factors as zeros
+    _R_H = 0;
+    _R_V = 0;
+    _R_LD = 0;
+    _R_RD = 0;
 
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+    // the statistics cache is filled again for the next ROI
+    _moments_ready = false;
+    _entropies_ready = false;
+    _joint_entropy_ready = false;
+}
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += (i - mu_x_H) * (j - mu_y_H) * _p_H[i][j] / (sigma_x_H * sigma_y_H);
-            f_V += (i - mu_x_V) * (j - mu_y_V) * _p_V[i][j] / (sigma_x_V * sigma_y_V);
-            f_LD += (i - mu_x_LD) * (j - mu_y_LD) * _p_LD[i][j] / (sigma_x_LD * sigma_y_LD);
-            f_RD += (i - mu_x_RD) * (j - mu_y_RD) * _p_RD[i][j] / (sigma_x_RD * sigma_y_RD);
-        }
+void TextureAnalysis::Normalization() {
+    // The features are taken from the counts and the pair totals, and the probability matrices are only filled by DenseP() for the
+    // features still reading them. Without any pair in a direction they are 0 / 0 everywhere, so they then cover all the levels.
+    bool empty_direction = (_R_H == 0) || (_R_V == 0) || (_R_LD == 0) || (_R_RD == 0);
+    if (empty_direction || (_range.begin >= _range.end)) {
+        _range = {0, _Ng};
     }
 
-    f(f_H, f_V, f_LD, f_RD);
+    // calculate probability vectors
+    CalculateMarginals();
+    UpdateXLogXTable();
+
+    // calculate the first-order statistics of the pixels in the region
+    CalculatePixelStatistics();
+}
+
+void TextureAnalysis::CalculateMarginals() {
+    // the kernel writes the marginals interleaved by direction
+    _marginals.resize((5 * _Ng - 1) * num_directions);
+    double* px = _marginals.data();
+    double* py = px + _Ng * num_directions;
+    double* p_xny = py + _Ng * num_directions;
+    double* p_xpy = p_xny + _Ng * num_directions;
+    double R[num_directions] = {(double)_R_H, (double)_R_V, (double)_R_LD, (double)_R_RD};
+    if (_sparse) {
+        _kernels->sparse_marginals(_sparse_P.rows.data(), _sparse_P.cols.data(), _sparse_P.counts.data(), _sparse_P.Size(), _Ng,
+            _symmetric, R, px, py, p_xpy, p_xny);
+    } else {
+        _kernels->marginals(_P.Data(), _Ng, _range, _symmetric, R, px, py, p_xpy, p_xny);
+    }
+    SplitMarginals();
 }
 
-void TextureAnalysis::GetCorrelationIAnotherWay(Features& f) {
-    // Calculate means
-    double mu_x_H = CalculateGLCMMean_i(_p_H);
-    double mu_x_V = CalculateGLCMMean_i(_p_V);
-    double mu_x_LD = CalculateGLCMMean_i(_p_LD);
-    double mu_x_RD = CalculateGLCMMean_i(_p_RD);
-
-    double mu_y_H = CalculateGLCMMean_j(_p_H);
-    double mu_y_V = CalculateGLCMMean_j(_p_V);
-    double mu_y_LD = CalculateGLCMMean_j(_p_LD);
-    double mu_y_RD = CalculateGLCMMean_j(_p_RD);
-
-    // Calculate STDs
-    double sigma_x_H = CalculateGLCMSTD_i(_p_H);
-    double sigma_x_V = CalculateGLCMSTD_i(_p_V);
-    double sigma_x_LD = CalculateGLCMSTD_i(_p_LD);
-    double sigma_x_RD = CalculateGLCMSTD_i(_p_RD);
-
-    double sigma_y_H = CalculateGLCMSTD_j(_p_H);
-    double sigma_y_V = CalculateGLCMSTD_j(_p_V);
-    double sigma_y_LD = CalculateGLCMSTD_j(_p_LD);
-    double sigma_y_RD = CalculateGLCMSTD_j(_p_RD);
+void TextureAnalysis::SplitMarginals() {
+    const double* px = _marginals.data();
+    const double* py = px + _Ng * num_directions;
+    const double* p_xny = py + _Ng * num_directions;
+    const double* p_xpy = p_xny + _Ng * num_directions;
+    for (int k = 0; k < _Ng; ++k) {
+        _px_H[k] = px[k * num_directions];
+        _px_V[k] = px[k * num_directions + 1];
+        _px_LD[k] = px[k * num_directions + 2];
+        _px_RD[k] = px[k * num_directions + 3];
 
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+        _py_H[k] = py[k * num_directions];
+        _py_V[k] = py[k * num_directions + 1];
+        _py_LD[k] = py[k * num_directions + 2];
+        _py_RD[k] = py[k * num_directions + 3];
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += (i - mu_x_H) * (j - mu_y_H) * _p_H[i][j] / (sigma_x_H * sigma_y_H);
-            f_V += (i - mu_x_V) * (j - mu_y_V) * _p_V[i][j] / (sigma_x_V * sigma_y_V);
-            f_LD += (i - mu_x_LD) * (j - mu_y_LD) * _p_LD[i][j] / (sigma_x_LD * sigma_y_LD);
-            f_RD += (i - mu_x_RD) * (j - mu_y_RD) * _p_RD[i][j] / (sigma_x_RD * sigma_y_RD);
-        }
+        _p_xny_H[k] = p_xny[k * num_directions];
+        _p_xny_V[k] = p_xny[k * num_directions + 1];
+        _p_xny_LD[k] = p_xny[k * num_directions + 2];
+        _p_xny_RD[k] = p_xny[k * num_directions + 3];
     }
 
-    f(f_H, f_V, f_LD, f_RD);
+    for (int k = 0; k < 2 * _Ng - 1; ++k) {
+        _p_xpy_H[k] = p_xpy[k * num_directions];
+        _p_xpy_V[k] = p_xpy[k * num_directions + 1];
+        _p_xpy_LD[k] = p_xpy[k * num_directions + 2];
+        _p_xpy_RD[k] = p_xpy[k * num_directions + 3];
+    }
 }
 
-void TextureAnalysis::GetCorrelationII(Features& f) {
-    // Calculate means
-    double mu_x_H = CalculateMean(_px_H);
-    double mu_x_V = CalculateMean(_px_V);
-    double mu_x_LD = CalculateMean(_px_LD);
-    double mu_x_RD = CalculateMean(_px_RD);
-
-    double mu_y_H = CalculateMean(_py_H);
-    double mu_y_V = CalculateMean(_py_V);
-    double mu_y_LD = CalculateMean(_py_LD);
-    double mu_y_RD = CalculateMean(_py_RD);
-
-    // Calculate STDs
-    double sigma_x_H = CalculateSTD(_px_H);
-    double sigma_x_V = CalculateSTD(_px_V);
-    double sigma_x_LD = CalculateSTD(_px_LD);
-    double sigma_x_RD = CalculateSTD(_px_RD);
-
-    double sigma_y_H = CalculateSTD(_py_H);
-    double sigma_y_V = CalculateSTD(_py_V);
-    double sigma_y_LD = CalculateSTD(_py_LD);
-    double sigma_y_RD = CalculateSTD(_py_RD);
+void TextureAnalysis::CalculateMarginalSums(MarginalSums& sums) {
+    const double* px = _marginals.data();
+    const double* py = px + _Ng * num_directions;
+    const double* p_xny = py + _Ng * num_directions;
+    const double* p_xpy = p_xny + _Ng * num_directions;
 
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+    UpdateMoments();
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += (i * j) * _p_H[i][j];
-            f_V += (i * j) * _p_V[i][j];
-            f_LD += (i * j) * _p_LD[i][j];
-            f_RD += (i * j) * _p_RD[i][j];
+    for (int d = 0; d < num_directions; ++d) {
+        sums.contrast[d] = 0.0;
+        sums.dissimilarity[d] = 0.0;
+        sums.homogeneity_i[d] = 0.0;
+        sums.homogeneity_ii[d] = 0.0;
+        sums.inverse_difference[d] = 0.0;
+        sums.cluster_shade[d] = 0.0;
+        sums.cluster_prominence[d] = 0.0;
+    }
+
+    // the pair features depending on i - j only
+    for (int n = 0; n < _Ng; ++n) {
+        for (int d = 0; d < num_directions; ++d) {
+            double p_n = p_xny[n * num_directions + d];
+            sums.contrast[d] += (n * n) * p_n;
+            sums.dissimilarity[d] += n * p_n;
+            sums.homogeneity_i[d] += p_n / (1 + n);
+            sums.homogeneity_ii[d] += p_n / (1 + n * n);
+            sums.inverse_difference[d] += p_n / (1 + (n * n / _Ng));
         }
     }
 
-    f_H = (f_H - (mu_x_H * mu_y_H)) / (sigma_x_H * sigma_y_H);
-    f_V = (f_V - (mu_x_V * mu_y_V)) / (sigma_x_V * sigma_y_V);
-    f_LD = (f_LD - (mu_x_LD * mu_y_LD)) / (sigma_x_LD * sigma_y_LD);
-    f_RD = (f_RD - (mu_x_RD * mu_y_RD)) / (sigma_x_RD * sigma_y_RD);
+    // the pair features depending on i + j only
+    for (int k = 0; k < 2 * _Ng - 1; ++k) {
+        for (int d = 0; d < num_directions; ++d) {
+            double p_k = p_xpy[k * num_directions + d];
+            double shift = k - _stats.mu_x[d] - _stats.mu_y[d];
+            sums.cluster_shade[d] += shift * shift * shift * p_k;
+            sums.cluster_prominence[d] += shift * shift * shift * shift * p_k;
+        }
+    }
+}
 
-    f(f_H, f_V, f_LD, f_RD);
+void TextureAnalysis::UpdateXLogXTable() {
+    long max_count = std::min((long)std::max({_R_H, _R_V, _R_LD, _R_RD}), max_xlogx_counts - 1);
+    for (long c = (long)_xlogx.size(); c <= max_count; ++c) {
+        _xlogx.push_back(c > 0 ? c * log((double)c) : 0.0);
+    }
 }
 
-void TextureAnalysis::GetCorrelationIIAnotherWay(Features& f) {
-    // Calculate means
-    double mu_x_H = CalculateGLCMMean_i(_p_H);
-    double mu_x_V = CalculateGLCMMean_i(_p_V);
-    double mu_x_LD = CalculateGLCMMean_i(_p_LD);
-    double mu_x_RD = CalculateGLCMMean_i(_p_RD);
-
-    double mu_y_H = CalculateGLCMMean_j(_p_H);
-    double mu_y_V = CalculateGLCMMean_j(_p_V);
-    double mu_y_LD = CalculateGLCMMean_j(_p_LD);
-    double mu_y_RD = CalculateGLCMMean_j(_p_RD);
-
-    // Calculate STDs
-    double sigma_x_H = CalculateGLCMSTD_i(_p_H);
-    double sigma_x_V = CalculateGLCMSTD_i(_p_V);
-    double sigma_x_LD = CalculateGLCMSTD_i(_p_LD);
-    double sigma_x_RD = CalculateGLCMSTD_i(_p_RD);
-
-    double sigma_y_H = CalculateGLCMSTD_j(_p_H);
-    double sigma_y_V = CalculateGLCMSTD_j(_p_V);
-    double sigma_y_LD = CalculateGLCMSTD_j(_p_LD);
-    double sigma_y_RD = CalculateGLCMSTD_j(_p_RD);
+void TextureAnalysis::CalculateJointSums(unsigned which, const double* mu_x, const double* mu_y, JointSums& sums) {
+    double R[num_directions] = {(double)_R_H, (double)_R_V, (double)_R_LD, (double)_R_RD};
+    XLogXTable xlogx = {_xlogx.data(), (int)_xlogx.size()};
+    if (_sparse) {
+        _kernels->sparse_joint_sums(_sparse_P.rows.data(), _sparse_P.cols.data(), _sparse_P.counts.data(), _sparse_P.Size(), _Ng,
+            _symmetric, R, xlogx, mu_x, mu_y, which, &sums);
+    } else {
+        _kernels->joint_sums(_P.Data(), _Ng, _range, _symmetric, R, xlogx, mu_x, mu_y, which, &sums);
+    }
+}
 
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+unsigned TextureAnalysis::SelectJointSums(const FeatureSet& types) {
+    unsigned which = 0;
+    types.ForEach([&which](Type type) {
+        switch (type) {
+            case Type::Energy:
+                which |= JointSums::Energy;
+                break;
+            case Type::Entropy:
+            case Type::InformationMeasuresOfCorrelationI:
+            case Type::InformationMeasuresOfCorrelationII:
+                which |= JointSums::Entropy;
+                break;
+            case Type::MaximumProbability:
+                which |= JointSums::Maximum;
+                break;
+            case Type::AutoCorrelation:
+            case Type::CorrelationII:
+            case Type::CorrelationIIAnotherWay:
+            case Type::CorrelationIII:
+                which |= JointSums::AutoCorrelation;
+                break;
+            case Type::CorrelationI:
+            case Type::CorrelationIAnotherWay:
+                which |= JointSums::Correlation;
+                break;
+            default:
+                break;
+        }
+    });
+    return which;
+}
+
+void TextureAnalysis::UpdateMoments() {
+    if (_moments_ready) {
+        return;
+    }
+    const double* px = _marginals.data();
+    const double* py = px + _Ng * num_directions;
+
+    for (int d = 0; d < num_directions; ++d) {
+        _stats.mu_x[d] = 0.0;
+        _stats.mu_y[d] = 0.0;
+        _stats.var_x[d] = 0.0;
+        _stats.var_y[d] = 0.0;
+    }
+
+    for (int i = 0; i < _Ng; ++i) {
+        for (int d = 0; d < num_directions; ++d) {
+            _stats.mu_x[d] += i * px[i * num_directions + d];
+            _stats.mu_y[d] += i * py[i * num_directions + d];
+        }
+    }
 
     for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += (i * j) * _p_H[i][j];
-            f_V += (i * j) * _p_V[i][j];
-            f_LD += (i * j) * _p_LD[i][j];
-            f_RD += (i * j) * _p_RD[i][j];
+        for (int d = 0; d < num_directions; ++d) {
+            _stats.var_x[d] += (i - _stats.mu_x[d]) * (i - _stats.mu_x[d]) * px[i * num_directions + d];
+            _stats.var_y[d] += (i - _stats.mu_y[d]) * (i - _stats.mu_y[d]) * py[i * num_directions + d];
         }
     }
 
-    f_H = (f_H - (mu_x_H * mu_y_H)) / (sigma_x_H * sigma_y_H);
-    f_V = (f_V - (mu_x_V * mu_y_V)) / (sigma_x_V * sigma_y_V);
-    f_LD = (f_LD - (mu_x_LD * mu_y_LD)) / (sigma_x_LD * sigma_y_LD);
-    f_RD = (f_RD - (mu_x_RD * mu_y_RD)) / (sigma_x_RD * sigma_y_RD);
+    for (int d = 0; d < num_directions; ++d) {
+        _stats.sigma_x[d] = sqrt(_stats.var_x[d]);
+        _stats.sigma_y[d] = sqrt(_stats.var_y[d]);
+    }
+    _moments_ready = true;
+}
 
-    f(f_H, f_V, f_LD, f_RD);
+void TextureAnalysis::UpdateEntropies() {
+    if (_entropies_ready) {
+        return;
+    }
+    _kernels->entropy(_marginals.data(), _Ng, _stats.HX);
+    _kernels->entropy(_marginals.data() + _Ng * num_directions, _Ng, _stats.HY);
+
+    // HXY1 = -sum(p_ij log(p_x(i) p_y(j))) = HX + HY, since p_x and p_y are the marginals of p, and
+    // HXY2 = -sum(p_x(i) p_y(j) log(p_x(i) p_y(j))) = HX + HY as well, since p_x and p_y sum to 1
+    for (int d = 0; d < num_directions; ++d) {
+        _stats.HXY1[d] = _stats.HX[d] + _stats.HY[d];
+        _stats.HXY2[d] = _stats.HX[d] + _stats.HY[d];
+    }
+    _entropies_ready = true;
 }
 
-void TextureAnalysis::GetCorrelationIII(Features& f) {
-    // Calculate means
-    double mu_x_H = CalculateMean(_px_H);
-    double mu_x_V = CalculateMean(_px_V);
-    double mu_x_LD = CalculateMean(_px_LD);
-    double mu_x_RD = CalculateMean(_px_RD);
-
-    double mu_y_H = CalculateMean(_py_H);
-    double mu_y_V = CalculateMean(_py_V);
-    double mu_y_LD = CalculateMean(_py_LD);
-    double mu_y_RD = CalculateMean(_py_RD);
-
-    // Calculate STDs
-    double sigma_x_H = CalculateSTD(_px_H);
-    double sigma_x_V = CalculateSTD(_px_V);
-    double sigma_x_LD = CalculateSTD(_px_LD);
-    double sigma_x_RD = CalculateSTD(_px_RD);
-
-    double sigma_y_H = CalculateSTD(_py_H);
-    double sigma_y_V = CalculateSTD(_py_V);
-    double sigma_y_LD = CalculateSTD(_py_LD);
-    double sigma_y_RD = CalculateSTD(_py_RD);
+void TextureAnalysis::UpdateJointEntropy() {
+    if (_joint_entropy_ready) {
+        return;
+    }
+    double mu[num_directions] = {0.0, 0.0, 0.0, 0.0};
+    JointSums joint;
+    CalculateJointSums(JointSums::Entropy, mu, mu, joint);
+    SetJointEntropy(joint.entropy);
+}
 
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+void TextureAnalysis::SetJointEntropy(const double* HXY) {
+    std::copy(HXY, HXY + num_directions, _stats.HXY);
+    _joint_entropy_ready = true;
+}
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += (i * j) * _p_H[i][j];
-            f_V += (i * j) * _p_V[i][j];
-            f_LD += (i * j) * _p_LD[i][j];
-            f_RD += (i * j) * _p_RD[i][j];
+double TextureAnalysis::CalculateMaximalCorrelation(int direction) {
+    // Q = Dx^-1 P Dy^-1 P^T, with Dx and Dy the diagonal matrices of p_x and p_y, is similar to the symmetric S = A A^T with
+    // A = Dx^-1/2 P Dy^-1/2, as Q = Dx^-1/2 S Dx^1/2. Over the levels of non-zero marginals S is found by one matrix product and
+    // its eigenvalues by the self-adjoint solver; the zero rows and columns of Q only add zero eigenvalues.
+    const double* px = _marginals.data();
+    const double* py = px + _Ng * num_directions;
+    std::vector<int> rows;
+    std::vector<int> cols;
+    for (int k = _range.begin; k < _range.end; ++k) {
+        if (px[k * num_directions + direction] > 0) {
+            rows.push_back(k);
+        }
+        if (py[k * num_directions + direction] > 0) {
+            cols.push_back(k);
+        }
+    }
+    if (rows.empty()) {
+        return std::numeric_limits<double>::quiet_NaN(); // no pair in this direction
+    }
+
+    Eigen::MatrixXd A(rows.size(), cols.size());
+    for (int r = 0; r < (int)rows.size(); ++r) {
+        for (int c = 0; c < (int)cols.size(); ++c) {
+            A(r, c) = _p(rows[r], cols[c], direction) /
+                      sqrt(px[rows[r] * num_directions + direction] * py[cols[c] * num_directions + direction]);
         }
     }
 
-    f_H = (f_H - (mu_x_H * mu_y_H)) / (sigma_x_H * sigma_y_H * sigma_x_H * sigma_y_H);
-    f_V = (f_V - (mu_x_V * mu_y_V)) / (sigma_x_V * sigma_y_V * sigma_x_V * sigma_y_V);
-    f_LD = (f_LD - (mu_x_LD * mu_y_LD)) / (sigma_x_LD * sigma_y_LD * sigma_x_LD * sigma_y_LD);
-    f_RD = (f_RD - (mu_x_RD * mu_y_RD)) / (sigma_x_RD * sigma_y_RD * sigma_x_RD * sigma_y_RD);
+    // A A^T and A^T A have the same non-zero eigenvalues, so the smaller one is used; only its lower triangle is filled
+    int size = std::min(A.rows(), A.cols());
+    Eigen::MatrixXd S = Eigen::MatrixXd::Zero(size, size);
+    if (A.rows() <= A.cols()) {
+        S.selfadjointView<Eigen::Lower>().rankUpdate(A);
+    } else {
+        S.selfadjointView<Eigen::Lower>().rankUpdate(A.transpose());
+    }
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(S, Eigen::EigenvaluesOnly);
 
-    f(f_H, f_V, f_LD, f_RD);
+    std::vector<double> eigens(solver.eigenvalues().data(), solver.eigenvalues().data() + size);
+    if ((size < _Ng) || (size == 1)) {
+        eigens.push_back(0.0);
+    }
+
+    // get second largest eigenvalue
+    std::nth_element(eigens.begin(), eigens.begin() + 1, eigens.end(), std::greater<double>());
+    return eigens[1];
 }
 
-void TextureAnalysis::GetSumOfSquares(Features& f) {
-    double mean_H_x = CalculateGLCMMean_i(_p_H);
-    double mean_V_x = CalculateGLCMMean_i(_p_V);
-    double mean_LD_x = CalculateGLCMMean_i(_p_LD);
-    double mean_RD_x = CalculateGLCMMean_i(_p_RD);
+//===============================================================================================================
+// Calculate texture feature coefficients
+//===============================================================================================================
 
-    double mean_H_y = CalculateGLCMMean_j(_p_H);
-    double mean_V_y = CalculateGLCMMean_j(_p_V);
-    double mean_LD_y = CalculateGLCMMean_j(_p_LD);
-    double mean_RD_y = CalculateGLCMMean_j(_p_RD);
+void TextureAnalysis::GetEnergy(Features& f) {
+    double values[num_directions];
+    _kernels->energy(DenseP(), _Ng, _range, values);
+    f(values[0], values[1], values[2], values[3]);
+}
 
+void TextureAnalysis::GetContrast(Features& f) {
+    // p_{x-y} holds the sums of p over |i - j| = n
     double f_H = 0.0;
     double f_V = 0.0;
     double f_LD = 0.0;
     double f_RD = 0.0;
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += (i - mean_H_x) * (i - mean_H_x) * _p_H[i][j] + (j - mean_H_y) * (j - mean_H_y) * _p_H[i][j];
-            f_V += (i - mean_V_x) * (i - mean_V_x) * _p_V[i][j] + (j - mean_V_y) * (j - mean_V_y) * _p_V[i][j];
-            f_LD += (i - mean_LD_x) * (i - mean_LD_x) * _p_LD[i][j] + (j - mean_LD_y) * (j - mean_LD_y) * _p_LD[i][j];
-            f_RD += (i - mean_RD_x) * (i - mean_RD_x) * _p_RD[i][j] + (j - mean_RD_y) * (j - mean_RD_y) * _p_RD[i][j];
-        }
+    for (int n = 0; n < _Ng; ++n) {
+        f_H += (n * n) * _p_xny_H[n];
+        f_V += (n * n) * _p_xny_V[n];
+        f_LD += (n * n) * _p_xny_LD[n];
+        f_RD += (n * n) * _p_xny_RD[n];
     }
 
     f(f_H, f_V, f_LD, f_RD);
 }
 
-void TextureAnalysis::GetSumOfSquares_i(Features& f) {
-    double mean_H = CalculateGLCMMean_i(_p_H);
-    double mean_V = CalculateGLCMMean_i(_p_V);
-    double mean_LD = CalculateGLCMMean_i(_p_LD);
-    double mean_RD = CalculateGLCMMean_i(_p_RD);
+void TextureAnalysis::GetContrastAnotherWay(Features& f) {
+    double values[num_directions];
+    _kernels->contrast(DenseP(), _Ng, _range, values);
+    f(values[0], values[1], values[2], values[3]);
+}
 
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+void TextureAnalysis::GetCorrelationI(Features& f) {
+    UpdateMoments();
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += (i - mean_H) * (i - mean_H) * _p_H[i][j];
-            f_V += (i - mean_V) * (i - mean_V) * _p_V[i][j];
-            f_LD += (i - mean_LD) * (i - mean_LD) * _p_LD[i][j];
-            f_RD += (i - mean_RD) * (i - mean_RD) * _p_RD[i][j];
-        }
+    double values[num_directions];
+    _kernels->correlation(DenseP(), _Ng, _range, _stats.mu_x, _stats.mu_y, _stats.sigma_x, _stats.sigma_y, values);
+    f(values[0], values[1], values[2], values[3]);
+}
+
+void TextureAnalysis::GetCorrelationIAnotherWay(Features& f) {
+    // the GLCM means and STDs sum(i p), sum(j p), ... are the moments of the marginals
+    UpdateMoments();
+
+    double values[num_directions];
+    _kernels->correlation(DenseP(), _Ng, _range, _stats.mu_x, _stats.mu_y, _stats.sigma_x, _stats.sigma_y, values);
+    f(values[0], values[1], values[2], values[3]);
+}
+
+void TextureAnalysis::GetCorrelationII(Features& f) {
+    UpdateMoments();
+
+    double values[num_directions];
+    _kernels->auto_correlation(DenseP(), _Ng, _range, values);
+    for (int k = 0; k < num_directions; ++k) {
+        values[k] = (values[k] - (_stats.mu_x[k] * _stats.mu_y[k])) / (_stats.sigma_x[k] * _stats.sigma_y[k]);
     }
 
-    f(f_H, f_V, f_LD, f_RD);
+    f(values[0], values[1], values[2], values[3]);
 }
 
-void TextureAnalysis::GetSumOfSquares_j(Features& f) {
-    double mean_H = CalculateGLCMMean_j(_p_H);
-    double mean_V = CalculateGLCMMean_j(_p_V);
-    double mean_LD = CalculateGLCMMean_j(_p_LD);
-    double mean_RD = CalculateGLCMMean_j(_p_RD);
+void TextureAnalysis::GetCorrelationIIAnotherWay(Features& f) {
+    // the GLCM means and STDs sum(i p), sum(j p), ... are the moments of the marginals
+    UpdateMoments();
 
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+    double values[num_directions];
+    _kernels->auto_correlation(DenseP(), _Ng, _range, values);
+    for (int k = 0; k < num_directions; ++k) {
+        values[k] = (values[k] - (_stats.mu_x[k] * _stats.mu_y[k])) / (_stats.sigma_x[k] * _stats.sigma_y[k]);
+    }
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += (j - mean_H) * (j - mean_H) * _p_H[i][j];
-            f_V += (j - mean_V) * (j - mean_V) * _p_V[i][j];
-            f_LD += (j - mean_LD) * (j - mean_LD) * _p_LD[i][j];
-            f_RD += (j - mean_RD) * (j - mean_RD) * _p_RD[i][j];
-        }
+    f(values[0], values[1], values[2], values[3]);
+}
+
+void TextureAnalysis::GetCorrelationIII(Features& f) {
+    UpdateMoments();
+
+    double values[num_directions];
+    _kernels->auto_correlation(DenseP(), _Ng, _range, values);
+    for (int k = 0; k < num_directions; ++k) {
+        values[k] = (values[k] - (_stats.mu_x[k] * _stats.mu_y[k])) / (_stats.var_x[k] * _stats.var_y[k]);
     }
 
-    f(f_H, f_V, f_LD, f_RD);
+    f(values[0], values[1], values[2], values[3]);
 }
 
-void TextureAnalysis::GetHomogeneityII(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+void TextureAnalysis::GetSumOfSquares(Features& f) {
+    // sum((i - mu_i)^2 p) + sum((j - mu_j)^2 p), the variances of the marginals
+    UpdateMoments();
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += _p_H[i][j] / (1 + (i - j) * (i - j));
-            f_V += _p_V[i][j] / (1 + (i - j) * (i - j));
-            f_LD += _p_LD[i][j] / (1 + (i - j) * (i - j));
-            f_RD += _p_RD[i][j] / (1 + (i - j) * (i - j));
-        }
+    double values[num_directions];
+    for (int k = 0; k < num_directions; ++k) {
+        values[k] = _stats.var_x[k] + _stats.var_y[k];
     }
+    f(values[0], values[1], values[2], values[3]);
+}
 
-    f(f_H, f_V, f_LD, f_RD);
+void TextureAnalysis::GetSumOfSquares_i(Features& f) {
+    UpdateMoments();
+    f(_stats.var_x[0], _stats.var_x[1], _stats.var_x[2], _stats.var_x[3]);
+}
+
+void TextureAnalysis::GetSumOfSquares_j(Features& f) {
+    UpdateMoments();
+    f(_stats.var_y[0], _stats.var_y[1], _stats.var_y[2], _stats.var_y[3]);
+}
+
+void TextureAnalysis::GetHomogeneityII(Features& f) {
+    double values[num_directions];
+    _kernels->homogeneity_ii(DenseP(), _Ng, _range, values);
+    f(values[0], values[1], values[2], values[3]);
 }
 
 void TextureAnalysis::GetSumAverage(Features& f) {
@@ -909,53 +1392,14 @@ void TextureAnalysis::GetSumVariance(Features& f) {
 }
 
 void TextureAnalysis::GetSumEntropy(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
-
-    for (int i = 0; i < (2 * _Ng - 1); ++i) {
-        if (_p_xpy_H[i] > 0) {
-            f_H -= _p_xpy_H[i] * log(_p_xpy_H[i]);
-        }
-        if (_p_xpy_V[i] > 0) {
-            f_V -= _p_xpy_V[i] * log(_p_xpy_V[i]);
-        }
-        if (_p_xpy_LD[i] > 0) {
-            f_LD -= _p_xpy_LD[i] * log(_p_xpy_LD[i]);
-        }
-        if (_p_xpy_RD[i] > 0) {
-            f_RD -= _p_xpy_RD[i] * log(_p_xpy_RD[i]);
-        }
-    }
-
-    f(f_H, f_V, f_LD, f_RD);
+    double values[num_directions];
+    _kernels->entropy(_marginals.data() + 3 * _Ng * num_directions, 2 * _Ng - 1, values);
+    f(values[0], values[1], values[2], values[3]);
 }
 
 void TextureAnalysis::GetEntropy(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
-
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            if (_p_H[i][j] > 0) {
-                f_H -= _p_H[i][j] * log(_p_H[i][j]);
-            }
-            if (_p_V[i][j] > 0) {
-                f_V -= _p_V[i][j] * log(_p_V[i][j]);
-            }
-            if (_p_LD[i][j] > 0) {
-                f_LD -= _p_LD[i][j] * log(_p_LD[i][j]);
-            }
-            if (_p_RD[i][j] > 0) {
-                f_RD -= _p_RD[i][j] * log(_p_RD[i][j]);
-            }
-        }
-    }
-
-    f(f_H, f_V, f_LD, f_RD);
+    UpdateJointEntropy();
+    f(_stats.HXY[0], _stats.HXY[1], _stats.HXY[2], _stats.HXY[3]);
 }
 
 void TextureAnalysis::GetDifferenceVariance(Features& f) {
@@ -975,107 +1419,36 @@ void TextureAnalysis::GetDifferenceVariance(Features& f) {
 }
 
 void TextureAnalysis::GetDifferenceEntropy(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
-
-    for (int i = 0; i < _Ng; ++i) {
-        if (_p_xny_H[i] > 0) {
-            f_H -= _p_xny_H[i] * log(_p_xny_H[i]);
-        }
-        if (_p_xny_V[i] > 0) {
-            f_V -= _p_xny_V[i] * log(_p_xny_V[i]);
-        }
-        if (_p_xny_LD[i] > 0) {
-            f_LD -= _p_xny_LD[i] * log(_p_xny_LD[i]);
-        }
-        if (_p_xny_RD[i] > 0) {
-            f_RD -= _p_xny_RD[i] * log(_p_xny_RD[i]);
-        }
-    }
-
-    f(f_H, f_V, f_LD, f_RD);
+    double values[num_directions];
+    _kernels->entropy(_marginals.data() + 2 * _Ng * num_directions, _Ng, values);
+    f(values[0], values[1], values[2], values[3]);
 }
 
 void TextureAnalysis::GetInformationMeasuresOfCorrelation(Features& f1, Features& f2) {
     // calculate entropy factors
-    CalculateHX();
-    CalculateHY();
-    CalculateHXY();
-    CalculateHXY1();
-    CalculateHXY2();
-
-    // calculate the first Information Measures of Correlation
-    double f1_H;
-    double f1_V;
-    double f1_LD;
-    double f1_RD;
-
-    f1_H = (_HXY_H - _HXY1_H) / std::max(_HX_H, _HY_H);
-    f1_V = (_HXY_V - _HXY1_V) / std::max(_HX_V, _HY_V);
-    f1_LD = (_HXY_LD - _HXY1_LD) / std::max(_HX_LD, _HY_LD);
-    f1_RD = (_HXY_RD - _HXY1_RD) / std::max(_HX_RD, _HY_RD);
-
-    f1(f1_H, f1_V, f1_LD, f1_RD);
+    UpdateEntropies();
+    UpdateJointEntropy();
 
-    // calculate the second Information Measures of Correlation
-    double f2_H = sqrt(1.0 - exp(-2.0 * (_HXY2_H - _HXY_H)));
-    double f2_V = sqrt(1.0 - exp(-2.0 * (_HXY2_V - _HXY_V)));
-    double f2_LD = sqrt(1.0 - exp(-2.0 * (_HXY2_LD - _HXY_LD)));
-    double f2_RD = sqrt(1.0 - exp(-2.0 * (_HXY2_RD - _HXY_RD)));
+    // calculate the first and the second Information Measures of Correlation
+    double values1[num_directions];
+    double values2[num_directions];
+    for (int k = 0; k < num_directions; ++k) {
+        values1[k] = (_stats.HXY[k] - _stats.HXY1[k]) / std::max(_stats.HX[k], _stats.HY[k]);
+        values2[k] = sqrt(1.0 - exp(-2.0 * (_stats.HXY2[k] - _stats.HXY[k])));
+    }
 
-    f2(f2_H, f2_V, f2_LD, f2_RD);
+    f1(values1[0], values1[1], values1[2], values1[3]);
+    f2(values2[0], values2[1], values2[2], values2[3]);
 }
 
 void TextureAnalysis::GetMaximalCorrelationCoefficient(Features& f) {
-    // fill in Q matrices
-    Eigen::MatrixXd Q_H(_Ng, _Ng);
-    Eigen::MatrixXd Q_V(_Ng, _Ng);
-    Eigen::MatrixXd Q_LD(_Ng, _Ng);
-    Eigen::MatrixXd Q_RD(_Ng, _Ng);
-
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            Features q = CalculateQ(i, j);
-            // std::cout << "q_H = " << q.H << ", q_V = " << q.V << ", q_LD = " << q.LD << ", q_RD = " << q.RD << std::endl;
-            Q_H(i, j) = q.H;
-            Q_V(i, j) = q.V;
-            Q_LD(i, j) = q.LD;
-            Q_RD(i, j) = q.RD;
-        }
-    }
-
-    Eigen::EigenSolver<Eigen::MatrixXd> eigen_solver_Q_H(Q_H);
-    Eigen::EigenSolver<Eigen::MatrixXd> eigen_solver_Q_V(Q_V);
-    Eigen::EigenSolver<Eigen::MatrixXd> eigen_solver_Q_LD(Q_LD);
-    Eigen::EigenSolver<Eigen::MatrixXd> eigen_solver_Q_RD(Q_RD);
-
-    // get eigenvalues
-    std::vector<double> eigens_H;
-    std::vector<double> eigens_V;
-    std::vector<double> eigens_LD;
-    std::vector<double> eigens_RD;
-
-    for (int i = 0; i < _Ng; ++i) {
-        std::complex<double> E_H = eigen_solver_Q_H.eigenvalues().col(0)[i];
-        std::complex<double> E_V = eigen_solver_Q_V.eigenvalues().col(0)[i];
-        std::complex<double> E_LD = eigen_solver_Q_LD.eigenvalues().col(0)[i];
-        std::complex<double> E_RD = eigen_solver_Q_RD.eigenvalues().col(0)[i];
+    DenseP();
 
-        eigens_H.push_back(E_H.real());
-        eigens_V.push_back(E_V.real());
-        eigens_LD.push_back(E_LD.real());
-        eigens_RD.push_back(E_RD.real());
+    double values[num_directions];
+    for (int d = 0; d < num_directions; ++d) {
+        values[d] = CalculateMaximalCorrelation(d);
     }
-
-    // get second largest eigenvalues
-    std::nth_element(eigens_H.begin(), eigens_H.begin() + 1, eigens_H.end(), std::greater<double>());
-    std::nth_element(eigens_V.begin(), eigens_V.begin() + 1, eigens_V.end(), std::greater<double>());
-    std::nth_element(eigens_LD.begin(), eigens_LD.begin() + 1, eigens_LD.end(), std::greater<double>());
-    std::nth_element(eigens_RD.begin(), eigens_RD.begin() + 1, eigens_RD.end(), std::greater<double>());
-
-    f(eigens_H[1], eigens_V[1], eigens_LD[1], eigens_RD[1]);
+    f(values[0], values[1], values[2], values[3]);
 }
 
 void TextureAnalysis::GetMean(Features& f) {
@@ -1094,184 +1467,132 @@ void TextureAnalysis::GetStd(Features& f) {
     f(f_H, f_V, f_LD, f_RD);
 }
 
-void TextureAnalysis::GetAutoCorrelation(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+void TextureAnalysis::GetSkewness(Features& f) {
+    f(_pixel_values_skewness, _pixel_values_skewness, _pixel_values_skewness, _pixel_values_skewness);
+}
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += i * j * _p_H[i][j];
-            f_V += i * j * _p_V[i][j];
-            f_LD += i * j * _p_LD[i][j];
-            f_RD += i * j * _p_RD[i][j];
+void TextureAnalysis::GetKurtosis(Features& f) {
+    f(_pixel_values_kurtosis, _pixel_values_kurtosis, _pixel_values_kurtosis, _pixel_values_kurtosis);
+}
+
+void TextureAnalysis::GetPercentile(double percentile, Features& f) {
+    // the smallest pixel value v with at least percentile % of the pixels <= v
+    long N = std::accumulate(_histogram.begin(), _histogram.end(), 0L);
+    double value = std::numeric_limits<double>::quiet_NaN();
+    if (N > 0) {
+        double rank = std::max(percentile, 0.0) / 100.0 * N;
+        long cumulative = 0;
+        for (int v = 0; v < 256; ++v) {
+            cumulative += _histogram[v];
+            if ((_histogram[v] > 0) && (cumulative >= rank)) {
+                value = v;
+                break;
+            }
         }
     }
-
-    f(f_H, f_V, f_LD, f_RD);
+    f(value, value, value, value);
 }
 
-void TextureAnalysis::GetClusterProminence(Features& f) {
-    // Calculate means
-    double mu_x_H = CalculateMean(_px_H);
-    double mu_x_V = CalculateMean(_px_V);
-    double mu_x_LD = CalculateMean(_px_LD);
-    double mu_x_RD = CalculateMean(_px_RD);
+void TextureAnalysis::GetFirstOrderEnergy(Features& f) {
+    f(_pixel_values_energy, _pixel_values_energy, _pixel_values_energy, _pixel_values_energy);
+}
 
-    double mu_y_H = CalculateMean(_py_H);
-    double mu_y_V = CalculateMean(_py_V);
-    double mu_y_LD = CalculateMean(_py_LD);
-    double mu_y_RD = CalculateMean(_py_RD);
+void TextureAnalysis::GetFirstOrderEntropy(Features& f) {
+    f(_pixel_values_entropy, _pixel_values_entropy, _pixel_values_entropy, _pixel_values_entropy);
+}
 
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+void TextureAnalysis::GetAutoCorrelation(Features& f) {
+    double values[num_directions];
+    _kernels->auto_correlation(DenseP(), _Ng, _range, values);
+    f(values[0], values[1], values[2], values[3]);
+}
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += pow((i + j - mu_x_H - mu_y_H), 4) * _p_H[i][j];
-            f_V += pow((i + j - mu_x_V - mu_y_V), 4) * _p_V[i][j];
-            f_LD += pow((i + j - mu_x_LD - mu_y_LD), 4) * _p_LD[i][j];
-            f_RD += pow((i + j - mu_x_RD - mu_y_RD), 4) * _p_RD[i][j];
-        }
-    }
+void TextureAnalysis::GetClusterProminence(Features& f) {
+    UpdateMoments();
 
-    f(f_H, f_V, f_LD, f_RD);
+    double values[num_directions];
+    _kernels->cluster_prominence(DenseP(), _Ng, _range, _stats.mu_x, _stats.mu_y, values);
+    f(values[0], values[1], values[2], values[3]);
 }
 
 void TextureAnalysis::GetClusterShade(Features& f) {
-    // Calculate means
-    double mu_x_H = CalculateMean(_px_H);
-    double mu_x_V = CalculateMean(_px_V);
-    double mu_x_LD = CalculateMean(_px_LD);
-    double mu_x_RD = CalculateMean(_px_RD);
-
-    double mu_y_H = CalculateMean(_py_H);
-    double mu_y_V = CalculateMean(_py_V);
-    double mu_y_LD = CalculateMean(_py_LD);
-    double mu_y_RD = CalculateMean(_py_RD);
-
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+    UpdateMoments();
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += pow((i + j - mu_x_H - mu_y_H), 3) * _p_H[i][j];
-            f_V += pow((i + j - mu_x_V - mu_y_V), 3) * _p_V[i][j];
-            f_LD += pow((i + j - mu_x_LD - mu_y_LD), 3) * _p_LD[i][j];
-            f_RD += pow((i + j - mu_x_RD - mu_y_RD), 3) * _p_RD[i][j];
-        }
-    }
-
-    f(f_H, f_V, f_LD, f_RD);
+    double values[num_directions];
+    _kernels->cluster_shade(DenseP(), _Ng, _range, _stats.mu_x, _stats.mu_y, values);
+    f(values[0], values[1], values[2], values[3]);
 }
 
 void TextureAnalysis::GetDissimilarity(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
-
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += fabs(i - j) * _p_H[i][j];
-            f_V += fabs(i - j) * _p_V[i][j];
-            f_LD += fabs(i - j) * _p_LD[i][j];
-            f_RD += fabs(i - j) * _p_RD[i][j];
-        }
-    }
-
-    f(f_H, f_V, f_LD, f_RD);
+    double values[num_directions];
+    _kernels->dissimilarity(DenseP(), _Ng, _range, values);
+    f(values[0], values[1], values[2], values[3]);
 }
 
 void TextureAnalysis::GetHomogeneityI(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
-
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += _p_H[i][j] / (1 + fabs(i - j));
-            f_V += _p_V[i][j] / (1 + fabs(i - j));
-            f_LD += _p_LD[i][j] / (1 + fabs(i - j));
-            f_RD += _p_RD[i][j] / (1 + fabs(i - j));
-        }
-    }
-
-    f(f_H, f_V, f_LD, f_RD);
+    double values[num_directions];
+    _kernels->homogeneity_i(DenseP(), _Ng, _range, values);
+    f(values[0], values[1], values[2], values[3]);
 }
 
 void TextureAnalysis::GetMaximumProbability(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+    double values[num_directions];
+    _kernels->maximum_probability(DenseP(), _Ng, _range, values);
+    f(values[0], values[1], values[2], values[3]);
+}
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            if (_p_H[i][j] > f_H) {
-                f_H = _p_H[i][j];
-            }
-            if (_p_V[i][j] > f_V) {
-                f_V = _p_V[i][j];
-            }
-            if (_p_LD[i][j] > f_LD) {
-                f_LD = _p_LD[i][j];
-            }
-            if (_p_RD[i][j] > f_RD) {
-                f_RD = _p_RD[i][j];
-            }
-        }
-    }
+void TextureAnalysis::GetInverseDifferenceNormalized(Features& f) {
+    double values[num_directions];
+    _kernels->inverse_difference_normalized(DenseP(), _Ng, _range, values);
+    f(values[0], values[1], values[2], values[3]);
+}
 
-    f(f_H, f_V, f_LD, f_RD);
+void TextureAnalysis::GetInverseDifferenceMomentNormalized(Features& f) {
+    double values[num_directions];
+    _kernels->inverse_difference_normalized(DenseP(), _Ng, _range, values);
+    f(values[0], values[1], values[2], values[3]);
 }
 
-void TextureAnalysis::GetInverseDifferenceNormalized(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+FeatureResults TextureAnalysis::Calculate(const FeatureSet& types) {
+    FeatureResults results;
+    Calculate(types, results);
+    return results;
+}
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += _p_H[i][j] / (1 + (abs(i - j) * abs(i - j) / _Ng));
-            f_V += _p_V[i][j] / (1 + (abs(i - j) * abs(i - j) / _Ng));
-            f_LD += _p_LD[i][j] / (1 + (abs(i - j) * abs(i - j) / _Ng));
-            f_RD += _p_RD[i][j] / (1 + (abs(i - j) * abs(i - j) / _Ng));
-        }
+void TextureAnalysis::Calculate(const FeatureSet& types, FeatureResults& results) {
+    // Only energy, entropy, maximum probability and the (auto) correlations need the joint probabilities; they are taken in one
+    // traversal of the matrices. The other features are finished from the marginals in O(Ng), using the sums over |i - j| = n
+    // and i + j = k, and HXY1 = HXY2 = HX + HY for the information measures of correlation. The moments and the entropies are
+    // taken from the statistics cache, and the joint entropy found here is kept in it for the later calls.
+    unsigned which = SelectJointSums(types);
+    if (_joint_entropy_ready) {
+        which &= ~JointSums::Entropy;
     }
-
-    f(f_H, f_V, f_LD, f_RD);
+    JointSums joint;
+    if (which != 0) {
+        UpdateMoments();
+        CalculateJointSums(which, _stats.mu_x, _stats.mu_y, joint);
+    }
+    if (which & JointSums::Entropy) {
+        SetJointEntropy(joint.entropy);
+    }
+    CalculateFromSums(types, joint, results);
 }
 
-void TextureAnalysis::GetInverseDifferenceMomentNormalized(Features& f) {
-    double f_H = 0.0;
-    double f_V = 0.0;
-    double f_LD = 0.0;
-    double f_RD = 0.0;
+void TextureAnalysis::CalculateFromSums(const FeatureSet& types, const JointSums& joint, FeatureResults& results) {
+    MarginalSums m;
+    CalculateMarginalSums(m);
 
-    for (int i = 0; i < _Ng; ++i) {
-        for (int j = 0; j < _Ng; ++j) {
-            f_H += _p_H[i][j] / (1 + ((i - j) * (i - j) / _Ng));
-            f_V += _p_V[i][j] / (1 + ((i - j) * (i - j) / _Ng));
-            f_LD += _p_LD[i][j] / (1 + ((i - j) * (i - j) / _Ng));
-            f_RD += _p_RD[i][j] / (1 + ((i - j) * (i - j) / _Ng));
-        }
+    double sigma_xy[num_directions];
+    for (int d = 0; d < num_directions; ++d) {
+        sigma_xy[d] = _stats.sigma_x[d] * _stats.sigma_y[d];
     }
 
-    f(f_H, f_V, f_LD, f_RD);
-}
+    results.Clear();
+    double values[num_directions];
+    auto set_results = [&results](Type type, const double* f) { results[type](f[0], f[1], f[2], f[3]); };
 
-std::map<Type, Features> TextureAnalysis::Calculate(const std::set<Type>& types) {
-    std::map<Type, Features> results;
-    bool information_measures_of_correlation_done = false;
-    for (auto type : types) {
+    types.ForEach([&](Type type) {
         switch (type) {
             case Type::Mean:
                 GetMean(results[Type::Mean]);
@@ -1280,61 +1601,67 @@ std::map<Type, Features> TextureAnalysis::Calculate(const std::set<Type>& types)
                 GetStd(results[Type::Std]);
                 break;
             case Type::AutoCorrelation:
-                GetAutoCorrelation(results[Type::AutoCorrelation]);
+                set_results(type, joint.auto_correlation);
                 break;
             case Type::Contrast:
-                GetContrast(results[Type::Contrast]);
-                break;
             case Type::ContrastAnotherWay:
-                GetContrastAnotherWay(results[Type::ContrastAnotherWay]);
+                set_results(type, m.contrast);
                 break;
             case Type::CorrelationI:
-                GetCorrelationI(results[Type::CorrelationI]);
-                break;
             case Type::CorrelationIAnotherWay:
-                GetCorrelationIAnotherWay(results[Type::CorrelationIAnotherWay]);
+                for (int d = 0; d < num_directions; ++d) {
+                    values[d] = joint.correlation[d] / sigma_xy[d];
+                }
+                set_results(type, values);
                 break;
             case Type::CorrelationII:
-                GetCorrelationII(results[Type::CorrelationII]);
-                break;
             case Type::CorrelationIIAnotherWay:
-                GetCorrelationIIAnotherWay(results[Type::CorrelationIIAnotherWay]);
+                for (int d = 0; d < num_directions; ++d) {
+                    values[d] = (joint.auto_correlation[d] - (_stats.mu_x[d] * _stats.mu_y[d])) / sigma_xy[d];
+                }
+                set_results(type, values);
                 break;
             case Type::CorrelationIII:
-                GetCorrelationIII(results[Type::CorrelationIII]);
+                for (int d = 0; d < num_directions; ++d) {
+                    values[d] = (joint.auto_correlation[d] - (_stats.mu_x[d] * _stats.mu_y[d])) / (sigma_xy[d] * sigma_xy[d]);
+                }
+                set_results(type, values);
                 break;
             case Type::ClusterProminence:
-                GetClusterProminence(results[Type::ClusterProminence]);
+                set_results(type, m.cluster_prominence);
                 break;
             case Type::ClusterShade:
-                GetClusterShade(results[Type::ClusterShade]);
+                set_results(type, m.cluster_shade);
                 break;
             case Type::Dissimilarity:
-                GetDissimilarity(results[Type::Dissimilarity]);
+                set_results(type, m.dissimilarity);
                 break;
             case Type::Energy:
-                GetEnergy(results[Type::Energy]);
+                set_results(type, joint.energy);
                 break;
             case Type::Entropy:
-                GetEntropy(results[Type::Entropy]);
+                set_results(type, _stats.HXY);
                 break;
             case Type::HomogeneityI:
-                GetHomogeneityI(results[Type::HomogeneityI]);
+                set_results(type, m.homogeneity_i);
                 break;
             case Type::HomogeneityII:
-                GetHomogeneityII(results[Type::HomogeneityII]);
+                set_results(type, m.homogeneity_ii);
                 break;
             case Type::MaximumProbability:
-                GetMaximumProbability(results[Type::MaximumProbability]);
+                set_results(type, joint.maximum);
                 break;
             case Type::SumOfSquares:
-                GetSumOfSquares(results[Type::SumOfSquares]);
+                for (int d = 0; d < num_directions; ++d) {
+                    values[d] = _stats.var_x[d] + _stats.var_y[d];
+                }
+                set_results(type, values);
                 break;
             case Type::SumOfSquaresI:
-                GetSumOfSquares_i(results[Type::SumOfSquaresI]);
+                set_results(type, _stats.var_x);
                 break;
             case Type::SumOfSquaresJ:
-                GetSumOfSquares_j(results[Type::SumOfSquaresJ]);
+                set_results(type, _stats.var_y);
                 break;
             case Type::SumAverage:
                 GetSumAverage(results[Type::SumAverage]);
@@ -1352,36 +1679,54 @@ std::map<Type, Features> TextureAnalysis::Calculate(const std::set<Type>& types)
                 GetDifferenceEntropy(results[Type::DifferenceEntropy]);
                 break;
             case Type::InformationMeasuresOfCorrelationI:
-                if (!information_measures_of_correlation_done) {
-                    GetInformationMeasuresOfCorrelation(
-                        results[Type::InformationMeasuresOfCorrelationI], results[Type::InformationMeasuresOfCorrelationII]);
-                    information_measures_of_correlation_done = true;
-                }
-                break;
             case Type::InformationMeasuresOfCorrelationII:
-                if (!information_measures_of_correlation_done) {
-                    GetInformationMeasuresOfCorrelation(
-                        results[Type::InformationMeasuresOfCorrelationI], results[Type::InformationMeasuresOfCorrelationII]);
-                    information_measures_of_correlation_done = true;
+                UpdateEntropies();
+                for (int d = 0; d < num_directions; ++d) {
+                    values[d] = (_stats.HXY[d] - _stats.HXY1[d]) / std::max(_stats.HX[d], _stats.HY[d]);
                 }
+                set_results(Type::InformationMeasuresOfCorrelationI, values);
+                for (int d = 0; d < num_directions; ++d) {
+                    values[d] = sqrt(1.0 - exp(-2.0 * (_stats.HXY2[d] - _stats.HXY[d])));
+                }
+                set_results(Type::InformationMeasuresOfCorrelationII, values);
                 break;
             case Type::InverseDifferenceNormalized:
-                GetInverseDifferenceNormalized(results[Type::InverseDifferenceNormalized]);
-                break;
             case Type::InverseDifferenceMomentNormalized:
-                GetInverseDifferenceMomentNormalized(results[Type::InverseDifferenceMomentNormalized]);
+                set_results(type, m.inverse_difference);
+                break;
+            case Type::MaximalCorrelationCoefficient:
+                GetMaximalCorrelationCoefficient(results[Type::MaximalCorrelationCoefficient]);
+                break;
+            case Type::Skewness:
+                GetSkewness(results[Type::Skewness]);
+                break;
+            case Type::Kurtosis:
+                GetKurtosis(results[Type::Kurtosis]);
+                break;
+            case Type::Median:
+                GetPercentile(50.0, results[Type::Median]);
+                break;
+            case Type::Percentile10:
+                GetPercentile(10.0, results[Type::Percentile10]);
+                break;
+            case Type::Percentile90:
+                GetPercentile(90.0, results[Type::Percentile90]);
+                break;
+            case Type::FirstOrderEnergy:
+                GetFirstOrderEnergy(results[Type::FirstOrderEnergy]);
+                break;
+            case Type::FirstOrderEntropy:
+                GetFirstOrderEntropy(results[Type::FirstOrderEntropy]);
                 break;
             default:
                 std::cerr << "Unknown feature type!\n";
                 break;
         }
-    }
-
-    return results;
+    });
 }
 
-void TextureAnalysis::CalculateScore(double age, std::map<Type, Features>& features_map) {
-    if ((age > 0) && features_map.count(Type::Mean) && features_map.count(Type::Entropy) && features_map.count(Type::Contrast)) {
+void TextureAnalysis::CalculateScore(double age, FeatureResults& results) {
+    if ((age > 0) && results.Has(Type::Mean) && results.Has(Type::Entropy) && results.Has(Type::Contrast)) {
         std::vector<double> params = {1.138, -1.814, 1.416, 1.714};
 
         //        std::cout << "Calculate the Score with parameters:\n";
@@ -1390,17 +1735,17 @@ void TextureAnalysis::CalculateScore(double age, std::map<Type, Features>& featu
         //            std::cout << "params[" << i << "] = " << params[i] << "\n";
         //        }
 
-        double f_H = params[0] * age + params[1] * features_map.at(Type::Mean).H + params[2] * features_map.at(Type::Entropy).H +
-                     params[3] * features_map.at(Type::Contrast).H;
-        double f_V = params[0] * age + params[1] * features_map.at(Type::Mean).V + params[2] * features_map.at(Type::Entropy).V +
-                     params[3] * features_map.at(Type::Contrast).V;
-        double f_LD = params[0] * age + params[1] * features_map.at(Type::Mean).LD + params[2] * features_map.at(Type::Entropy).LD +
-                      params[3] * features_map.at(Type::Contrast).LD;
-        double f_RD = params[0] * age + params[1] * features_map.at(Type::Mean).RD + params[2] * features_map.at(Type::Entropy).RD +
-                      params[3] * features_map.at(Type::Contrast).RD;
-
-        features_map[Type::Score](f_H, f_V, f_LD, f_RD);
-        features_map[Type::Age](age, age, age, age);
+        double f_H = params[0] * age + params[1] * results[Type::Mean].H + params[2] * results[Type::Entropy].H +
+                     params[3] * results[Type::Contrast].H;
+        double f_V = params[0] * age + params[1] * results[Type::Mean].V + params[2] * results[Type::Entropy].V +
+                     params[3] * results[Type::Contrast].V;
+        double f_LD = params[0] * age + params[1] * results[Type::Mean].LD + params[2] * results[Type::Entropy].LD +
+                      params[3] * results[Type::Contrast].LD;
+        double f_RD = params[0] * age + params[1] * results[Type::Mean].RD + params[2] * results[Type::Entropy].RD +
+                      params[3] * results[Type::Contrast].RD;
+
+        results[Type::Score](f_H, f_V, f_LD, f_RD);
+        results[Type::Age](age, age, age, age);
     } else {
         std::cerr << "Can not calculate the Score!\n";
     }
@@ -1499,6 +1844,30 @@ std::string TextureAnalysis::TypeToString(const Type& type) {
         case Type::InverseDifferenceMomentNormalized:
             result = "Inverse Difference Moment Normalized";
             break;
+        case Type::MaximalCorrelationCoefficient:
+            result = "Maximal Correlation Coefficient";
+            break;
+        case Type::Skewness:
+            result = "Skewness";
+            break;
+        case Type::Kurtosis:
+            result = "Kurtosis";
+            break;
+        case Type::Median:
+            result = "Median";
+            break;
+        case Type::Percentile10:
+            result = "10th Percentile";
+            break;
+        case Type::Percentile90:
+            result = "90th Percentile";
+            break;
+        case Type::FirstOrderEnergy:
+            result = "First Order Energy";
+            break;
+        case Type::FirstOrderEntropy:
+            result = "First Order Entropy";
+            break;
         case Type::Score:
             result = "Score";
             break;
@@ -1538,18 +1907,18 @@ std::string TextureAnalysis::DirectionToString(const Direction& direction) {
     return result;
 }
 
-void TextureAnalysis::Print(const std::map<Type, Features>& features) {
-    for (auto feature : features) {
-        std::cout << TypeToString(feature.first) << std::endl;
-        std::cout << std::setw(30) << DirectionToString(Direction::H) << " = " << feature.second.H << std::endl;
-        std::cout << std::setw(30) << DirectionToString(Direction::V) << " = " << feature.second.V << std::endl;
-        std::cout << std::setw(30) << DirectionToString(Direction::LD) << " = " << feature.second.LD << std::endl;
-        std::cout << std::setw(30) << DirectionToString(Direction::RD) << " = " << feature.second.RD << std::endl;
-        std::cout << std::setw(30) << DirectionToString(Direction::Avg) << " = " << feature.second.Avg() << std::endl;
-    }
+void TextureAnalysis::Print(const FeatureResults& features) {
+    features.ForEach([this](Type type, const Features& feature) {
+        std::cout << TypeToString(type) << std::endl;
+        std::cout << std::setw(30) << DirectionToString(Direction::H) << " = " << feature.H << std::endl;
+        std::cout << std::setw(30) << DirectionToString(Direction::V) << " = " << feature.V << std::endl;
+        std::cout << std::setw(30) << DirectionToString(Direction::LD) << " = " << feature.LD << std::endl;
+        std::cout << std::setw(30) << DirectionToString(Direction::RD) << " = " << feature.RD << std::endl;
+        std::cout << std::setw(30) << DirectionToString(Direction::Avg) << " = " << feature.Avg() << std::endl;
+    });
 }
 
-void TextureAnalysis::SaveAsCSV(const std::string& image_name, std::map<Type, Features> features, const std::string& csv_name) {
+void TextureAnalysis::SaveAsCSV(const std::string& image_name, const FeatureResults& features, const std::string& csv_name) {
     // check whether the csv file exists or not
     bool csv_file_exists = fs::exists(csv_name);
 
@@ -1573,9 +1942,7 @@ void TextureAnalysis::SaveAsCSV(const std::string& image_name, std::map<Type, Fe
         csv_file << "Date,";
         csv_file << "Image,";
         csv_file << "Direction,";
-        for (std::map<Type, Features>::iterator it = features.begin(); it != features.end(); ++it) {
-            csv_file << TypeToString(it->first) << ",";
-        }
+        features.ForEach([this, &csv_file](Type type, const Features&) { csv_file << TypeToString(type) << ","; });
         csv_file << "\n";
     }
 
@@ -1583,45 +1950,35 @@ void TextureAnalysis::SaveAsCSV(const std::string& image_name, std::map<Type, Fe
     csv_file << current_time << ",";
     csv_file << image_base_name << ",";
     csv_file << DirectionToString(Direction::H) << ",";
-    for (std::map<Type, Features>::iterator it = features.begin(); it != features.end(); ++it) {
-        csv_file << it->second.H << ",";
-    }
+    features.ForEach([&csv_file](Type, const Features& feature) { csv_file << feature.H << ","; });
     csv_file << "\n";
 
     // write a row of V values
     csv_file << current_time << ",";
     csv_file << image_base_name << ",";
     csv_file << DirectionToString(Direction::V) << ",";
-    for (std::map<Type, Features>::iterator it = features.begin(); it != features.end(); ++it) {
-        csv_file << it->second.V << ",";
-    }
+    features.ForEach([&csv_file](Type, const Features& feature) { csv_file << feature.V << ","; });
     csv_file << "\n";
 
     // write a row of LD values
     csv_file << current_time << ",";
     csv_file << image_base_name << ",";
     csv_file << DirectionToString(Direction::LD) << ",";
-    for (std::map<Type, Features>::iterator it = features.begin(); it != features.end(); ++it) {
-        csv_file << it->second.LD << ",";
-    }
+    features.ForEach([&csv_file](Type, const Features& feature) { csv_file << feature.LD << ","; });
     csv_file << "\n";
 
     // write a row of RD values
     csv_file << current_time << ",";
     csv_file << image_base_name << ",";
     csv_file << DirectionToString(Direction::RD) << ",";
-    for (std::map<Type, Features>::iterator it = features.begin(); it != features.end(); ++it) {
-        csv_file << it->second.RD << ",";
-    }
+    features.ForEach([&csv_file](Type, const Features& feature) { csv_file << feature.RD << ","; });
     csv_file << "\n";
 
     // write a row of Avg values
     csv_file << current_time << ",";
     csv_file << image_base_name << ",";
     csv_file << DirectionToString(Direction::Avg) << ",";
-    for (std::map<Type, Features>::iterator it = features.begin(); it != features.end(); ++it) {
-        csv_file << it->second.Avg() << ",";
-    }
+    features.ForEach([&csv_file](Type, const Features& feature) { csv_file << feature.Avg() << ","; });
     csv_file << "\n";
 
     // close the csv file
@@ -1642,20 +1999,38 @@ std::string TextureAnalysis::GetCurrentTime() {
     return str;
 }
 
-void TextureAnalysis::CalculatePixelMean(const std::vector<double>& vec) {
-    _pixel_values_mean = 0.0;
-    for (int i = 0; i < vec.size(); ++i) {
-        _pixel_values_mean += vec[i];
-    }
-    _pixel_values_mean /= vec.size();
-}
-
-void TextureAnalysis::CalculatePixelSTD(const std::vector<double>& vec) {
-    CalculatePixelMean(vec);
-    _pixel_values_STD = 0.0;
-    for (int i = 0; i < vec.size(); ++i) {
-        _pixel_values_STD += (vec[i] - _pixel_values_mean) * (vec[i] - _pixel_values_mean);
+void TextureAnalysis::CalculatePixelStatistics() {
+    // Every statistic is a sum over the 256 pixel values weighted by their counts, instead of a pass over all the pixels. The mean
+    // is exact since the weighted sum is an integer; the STD is the sample one as before, the higher moments are the population ones.
+    long N = 0;
+    long sum = 0;
+    double energy = 0.0;
+    for (int v = 0; v < 256; ++v) {
+        N += _histogram[v];
+        sum += v * _histogram[v];
+        energy += (double)v * v * _histogram[v];
+    }
+    _pixel_values_mean = (double)sum / N;
+    _pixel_values_energy = energy;
+
+    double m2 = 0.0;
+    double m3 = 0.0;
+    double m4 = 0.0;
+    double entropy = 0.0;
+    for (int v = 0; v < 256; ++v) {
+        if (_histogram[v] > 0) {
+            double d = v - _pixel_values_mean;
+            double d2 = d * d;
+            m2 += d2 * _histogram[v];
+            m3 += d2 * d * _histogram[v];
+            m4 += d2 * d2 * _histogram[v];
+
+            double p = (double)_histogram[v] / N;
+            entropy -= p * log(p);
+        }
     }
-    _pixel_values_STD = _pixel_values_STD / (vec.size() - 1.0);
-    _pixel_values_STD = sqrt(_pixel_values_STD);
+    _pixel_values_STD = sqrt(m2 / (N - 1.0));
+    _pixel_values_skewness = (m3 / N) / pow(m2 / N, 1.5);
+    _pixel_values_kurtosis = (m4 / N) / ((m2 / N) * (m2 / N));
+    _pixel_values_entropy = (N > 0) ? entropy : std::numeric_limits<double>::quiet_NaN();
 }
@@ -1,12 +1,19 @@
 #ifndef GLCM_TEXTURE_FEATURE_ANALYSIS_HPP_
 #define GLCM_TEXTURE_FEATURE_ANALYSIS_HPP_
 
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
-#include <map>
 #include <opencv2/opencv.hpp>
-#include <set>
 #include <vector>
 
+#include "CooccurrenceMatrix.hpp"
+#include "FeatureKernels.hpp"
+
 namespace glcm {
 
 enum class Type {
@@ -40,12 +47,40 @@ enum class Type {
     InformationMeasuresOfCorrelationII,
     InverseDifferenceNormalized,
     InverseDifferenceMomentNormalized,
+    MaximalCorrelationCoefficient,
+    Skewness,
+    Kurtosis,
+    Median,
+    Percentile10,
+    Percentile90,
+    FirstOrderEnergy,
+    FirstOrderEntropy,
     Score,
     Age
 };
 
+constexpr int num_types = static_cast<int>(Type::Age) + 1;
+
 enum class Direction { H, V, LD, RD, Avg };
 
+// Offset of the pixel pairs (m, n) - (m + dy, n + dx). The pairs are counted in both orders, so -offset gives the same matrix; the
+// four directions are (0, d), (d, 0), (d, d) and (d, -d).
+struct Offset {
+    int dy;
+    int dx;
+};
+
+// Mapping of the pixel values onto the Ng gray levels of the matrices. The 16-bit and floating-point images are mapped pixel by pixel
+// while counting, the 8-bit ones through a table.
+enum class Quantization {
+    None,          // the pixel value is the gray level (clamped to Ng - 1)
+    Uniform,       // the 0 ~ 255 range (0 ~ 65535 for 16-bit, 0 ~ 1 for floating-point) split into Ng bins of the same width
+    FixedBinWidth, // bins of a given width starting from 0
+    MinMax,        // the [min, max] range of the region rescaled to the Ng levels
+    Percentile,    // the [lower, upper] percentile range of the region rescaled to the Ng levels, values outside are clamped
+    Window         // the [level - width / 2, level + width / 2] window rescaled to the Ng levels, values outside are clamped
+};
+
 struct Features {
     double H;
     double V;
@@ -60,18 +95,103 @@ struct Features {
         return Features();
     }
 
-    double Avg() {
+    double Avg() const {
         return ((H + V + LD + RD) / 4.0);
     }
 };
 
+// Selection of feature types, one bit per type
+class FeatureSet {
+public:
+    FeatureSet() = default;
+    FeatureSet(std::initializer_list<Type> types) {
+        for (auto type : types) {
+            Add(type);
+        }
+    }
+
+    void Add(Type type) {
+        _bits.set(static_cast<int>(type));
+    }
+    void Remove(Type type) {
+        _bits.reset(static_cast<int>(type));
+    }
+    bool Has(Type type) const {
+        return _bits.test(static_cast<int>(type));
+    }
+    bool Empty() const {
+        return _bits.none();
+    }
+    void Clear() {
+        _bits.reset();
+    }
+
+    template <typename Function>
+    void ForEach(Function function) const { // calls function(type) for the selected types in the Type order
+        for (int k = 0; k < num_types; ++k) {
+            if (_bits.test(k)) {
+                function(static_cast<Type>(k));
+            }
+        }
+    }
+
+private:
+    std::bitset<num_types> _bits;
+};
+
+// Features of the calculated types, held in a fixed array indexed by the type. The same results can be refilled for any number of
+// regions without allocating.
+class FeatureResults {
+public:
+    Features& operator[](Type type) { // marks the type as calculated
+        _types.Add(type);
+        return _features[static_cast<int>(type)];
+    }
+    const Features& operator[](Type type) const {
+        return _features[static_cast<int>(type)];
+    }
+    bool Has(Type type) const {
+        return _types.Has(type);
+    }
+    const FeatureSet& Types() const {
+        return _types;
+    }
+    void Clear() {
+        _types.Clear();
+    }
+
+    template <typename Function>
+    void ForEach(Function function) const { // calls function(type, features) for the calculated types in the Type order
+        _types.ForEach([&](Type type) { function(type, _features[static_cast<int>(type)]); });
+    }
+
+private:
+    std::array<Features, num_types> _features{};
+    FeatureSet _types;
+};
+
 class TextureAnalysis {
 public:
-    TextureAnalysis(int Ng);
+    TextureAnalysis(int Ng); // at most 256 gray levels, a larger Ng is reported and reduced to 256
     ~TextureAnalysis() = default;
 
+    // Ng itself, or 256 with an error above it: the pixel value tables, the level maps of the other depths and the histograms hold
+    // 256 levels only
+    static int ValidLevels(int Ng);
+
+    void SetNumThreads(int num_threads); // number of threads accumulating the matrices, 0 for all hardware threads (default: 1)
+    void SetQuantization(Quantization quantization); // gray level mapping applied while counting (default: None)
+    void SetBinWidth(double bin_width);              // bin width of Quantization::FixedBinWidth (default: 256 / Ng)
+    void SetPercentiles(double lower, double upper); // percentile range of Quantization::Percentile (default: 1 ~ 99)
+    void SetWindow(double level, double width);      // window of Quantization::Window (default: level 128, width 256)
+    void SetSymmetric(bool symmetric);               // count the pairs of rectangles once, in the upper triangle (default: false)
+
+    // The images are CV_8UC1, CV_16UC1, CV_32FC1 or CV_64FC1, and the NaN pixels of the floating-point ones are left out with their
+    // pairs. The first-order statistics are those of the pixel values for 8-bit images and of the gray levels otherwise. The wider
+    // pixel values are clamped to Ng - 1 without a quantization, so those images are read with one, such as Quantization::MinMax.
     void ProcessRectImage(const cv::Mat& image, int distance);
     void ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image, int distance);
+    void ProcessPolygonImage(const cv::Mat& original_image, const cv::Mat& mask_image, int distance, const cv::Rect& bounds);
 
     void GetMean(Features& f);                                            // Mean of selected region pixels
     void GetStd(Features& f);                                             // STD of selected region pixels
@@ -104,41 +224,237 @@ public:
     void GetInverseDifferenceMomentNormalized(Features& f);               // F22: Inverse Difference Moment Normalized
     void GetMaximalCorrelationCoefficient(Features& f);                   // Maximal Correlation Coefficient
 
-    std::map<Type, Features> Calculate(const std::set<Type>& types); // Calculate selected features
-    void CalculateScore(double age, std::map<Type, Features>& features_map);
+    // first-order statistics of the region pixels, the same for every direction
+    void GetSkewness(Features& f);                           // third standardized moment
+    void GetKurtosis(Features& f);                           // fourth standardized moment
+    void GetPercentile(double percentile, Features& f);      // smallest pixel value with the percentile of the region at or below it
+    void GetFirstOrderEnergy(Features& f);                   // sum of the squared pixel values
+    void GetFirstOrderEntropy(Features& f);                  // -sum(p log p) of the pixel value histogram
 
-    void Print(const std::map<Type, Features>& features);
-    void SaveAsCSV(const std::string& image_name, std::map<Type, Features> features, const std::string& csv_name);
+    void Calculate(const FeatureSet& types, FeatureResults& results); // Calculate selected features into the results, replacing them
+    FeatureResults Calculate(const FeatureSet& types);
+    void CalculateScore(double age, FeatureResults& results);
+
+    void Print(const FeatureResults& features);
+    void SaveAsCSV(const std::string& image_name, const FeatureResults& features, const std::string& csv_name);
 
 private:
+    friend class MultiDistanceAnalysis; // fill the matrices of several engines in one sweep
+    friend class OffsetSetAnalysis;
+    friend class VolumeAnalysis;
+    friend class FeatureMapAnalysis;
+    friend class TiledMapAnalysis;
+    friend class TileIndexAnalysis;
+
+    // Per direction statistics of the marginals shared by the features, each found at most once per ROI
+    struct MarginalStatistics {
+        double mu_x[num_directions];
+        double mu_y[num_directions];
+        double var_x[num_directions];
+        double var_y[num_directions];
+        double sigma_x[num_directions];
+        double sigma_y[num_directions];
+        double HX[num_directions];
+        double HY[num_directions];
+        double HXY[num_directions];  // -sum(p log p), from the joint probabilities
+        double HXY1[num_directions]; // -sum(p_ij log(p_x(i) p_y(j)))
+        double HXY2[num_directions]; // -sum(p_x(i) p_y(j) log(p_x(i) p_y(j)))
+    };
+
+    // Per direction sums over the marginals, each found in O(Ng)
+    struct MarginalSums {
+        double contrast[num_directions];           // sum(n^2 p_{x-y}(n))
+        double dissimilarity[num_directions];      // sum(n p_{x-y}(n))
+        double homogeneity_i[num_directions];      // sum(p_{x-y}(n) / (1 + n))
+        double homogeneity_ii[num_directions];     // sum(p_{x-y}(n) / (1 + n^2))
+        double inverse_difference[num_directions]; // sum(p_{x-y}(n) / (1 + n^2 / Ng))
+        double cluster_shade[num_directions];      // sum((k - mu_x - mu_y)^3 p_{x+y}(k))
+        double cluster_prominence[num_directions]; // sum((k - mu_x - mu_y)^4 p_{x+y}(k))
+    };
+
+    struct Span {
+        int row;
+        int begin;
+        int end;
+    };
+
+    // Private co-occurrence counts of one accumulation thread, added into the shared matrices afterwards
+    struct Partial {
+        void Reset(int Ng_, bool sparse_, bool symmetric_);
+
+        void Count(int i, int j, int direction) {
+            if (sparse) {
+                pairs.push_back((((unsigned)i * Ng + j) << 2) | direction);
+            } else {
+                ++P(i, j, direction);
+            }
+        }
+        void CountUpper(int i, int j, int direction) { // i <= j, the diagonal cells count the pair in both orders
+            if (sparse) {
+                pairs.push_back((((unsigned)i * Ng + j) << 2) | direction);
+            } else {
+                P(i, j, direction) += 1 + (i == j);
+            }
+        }
+        void CountPair(int a, int b, int direction) { // the pair in both orders
+            if (symmetric) {
+                CountUpper(std::min(a, b), std::max(a, b), direction);
+            } else {
+                Count(a, b, direction);
+                Count(b, a, direction);
+            }
+        }
+        void CountPairs(int a, int b, int direction, int count) { // the pair in both orders, count times, into P only
+            if (symmetric) {
+                int i = std::min(a, b);
+                int j = std::max(a, b);
+                P(i, j, direction) += count * (1 + (i == j));
+            } else {
+                P(a, b, direction) += count;
+                P(b, a, direction) += count;
+            }
+        }
+        void CountPairH(int a, int b) {
+            CountPair(a, b, 0);
+            R_H += 2;
+        }
+        void CountPairV(int a, int b) {
+            CountPair(a, b, 1);
+            R_V += 2;
+        }
+        void CountPairLD(int a, int b) {
+            CountPair(a, b, 2);
+            R_LD += 2;
+        }
+        void CountPairRD(int a, int b) {
+            CountPair(a, b, 3);
+            R_RD += 2;
+        }
+        void CountElemH(int i, int j) {
+            Count(i, j, 0);
+            ++R_H;
+        }
+        void CountElemV(int i, int j) {
+            Count(i, j, 1);
+            ++R_V;
+        }
+        void CountElemLD(int i, int j) {
+            Count(i, j, 2);
+            ++R_LD;
+        }
+        void CountElemRD(int i, int j) {
+            Count(i, j, 3);
+            ++R_RD;
+        }
+        void AddPairs(int direction, int count) { // pair total of a direction counted with Count() or CountPair()
+            int* R[num_directions] = {&R_H, &R_V, &R_LD, &R_RD};
+            *R[direction] += count;
+        }
+        void CountPixel(int pixel_value) {
+            ++histogram[pixel_value];
+        }
+        void TrackLevel(int level) {
+            levels.begin = std::min(levels.begin, level);
+            levels.end = std::max(levels.end, level + 1);
+        }
+        void TrackLevels(const uchar* level, const uchar* row, int begin, int end) {
+            for (int n = begin; n < end; ++n) {
+                TrackLevel(level[row[n]]);
+            }
+        }
+
+        int Ng = 0;
+        bool sparse = false;         // count into "pairs" instead of P
+        bool symmetric = false;      // count the pairs in the upper triangle only
+        std::vector<unsigned> pairs; // (i Ng + j) * 4 + direction of every counted pair
+        CooccurrenceMatrix<int> P;
+        LevelRange levels = {0, 0}; // levels of the pixels the counts may come from, which bounds the non-zero cells of P
+        int R_H = 0;
+        int R_V = 0;
+        int R_LD = 0;
+        int R_RD = 0;
+        std::vector<long> histogram; // pixel values of the band
+    };
+
+    // Gray level of a 16-bit or floating-point pixel value, -1 for NaN. It is (value - low) * factor / width rounded down and clamped
+    // to [0, max_level], which is the formula of the 8-bit table for every quantization.
+    struct LevelMap {
+        double low;
+        double factor;
+        double width;
+        int max_level;
+
+        int operator()(double value) const {
+            if (std::isnan(value)) {
+                return -1;
+            }
+            double level = (value - low) * factor / width;
+            return (level < 1.0) ? 0 : ((level >= max_level) ? max_level : (int)level);
+        }
+    };
+
     void ResetCache();
 
-    void CountElemH(int i, int j);
-    void CountElemV(int i, int j);
-    void CountElemLD(int i, int j);
-    void CountElemRD(int i, int j);
-    void PushPixelValue(int pixel_value);
+    bool CheckImage(const cv::Mat& image); // a supported single channel depth
+    // find the level map of a 16-bit or floating-point image, over the non-masked spans for the polygons
+    template <typename T>
+    void BuildLevelMap(const cv::Mat& image, bool polygon);
+    template <typename T, typename Function>
+    void ForEachRegionValue(const cv::Mat& image, bool polygon, Function function); // function(value) for the non-NaN pixels
+
+    // fill the pixel value to gray level table, from the histogram of the region for the min/max and percentile modes
+    bool NeedsHistogram();
+    void CountRectHistogram(const cv::Mat& image, std::vector<long>& histogram);
+    void CountSpansHistogram(const cv::Mat& image, std::vector<long>& histogram);
+    void BuildLevels(const std::vector<long>& histogram);
+
+    bool CheckDistance(int distance);
+    int CountBands(int num_rows, long num_pixels);
+    bool UseSparse(long counts_per_direction); // whether the matrices are so empty that the sparse format pays off
+    void AccumulateBands(int num_bands, const std::function<void(int, Partial&)>& accumulate); // run the bands and reduce them
+    void PreparePartials(int num_bands);
+    static void RunBands(int num_bands, const std::function<void(int)>& run_band); // one thread per band
+    void ReducePartials(int num_bands);
+
+    // count the pixel pairs of the four fixed offsets over row pointers
+    void AccumulateRect(const cv::Mat& image, int distance, int row_begin, int row_end, Partial& partial);
+    void AccumulateRectRows(const cv::Mat& image, int distance, int row_begin, int row_end, Partial& partial); // pixels and pairs
+    void TrackRectLevels(const cv::Mat& image, int distance, int row_end, Partial& partial); // levels of the band once its rows are done
+    // the same for any four offsets with dy >= 0, one per direction of the matrices; the offset (0, 0) is not counted
+    void AccumulateRectOffsets(const cv::Mat& image, const Offset* offsets, int row_begin, int row_end, Partial& partial);
+    void AccumulatePolygonOffsets(const cv::Mat& image, const Offset* offsets, int span_begin, int span_end, Partial& partial);
+    // the same for the 16-bit and floating-point images, which are quantized row by row and keep only the NaN-free pairs
+    template <typename T>
+    void AccumulateRectWide(const cv::Mat& image, int distance, int row_begin, int row_end, Partial& partial);
+    template <typename T>
+    void AccumulatePolygonWide(const cv::Mat& image, int distance, int span_begin, int span_end, Partial& partial);
+    // get the non-masked [begin, end) columns per row
+    void ExtractMaskSpans(const cv::Mat& mask_image, const cv::Rect& bounds);
+    // count the pixel pairs around the non-masked spans
+    void AccumulatePolygon(const cv::Mat& image, int distance, int span_begin, int span_end, Partial& partial);
 
     void Normalization();
 
-    void Calculate_px();
-    void Calculate_py();
-    void Calculate_p_xpy();
-    void Calculate_p_xny();
-
-    double CalculateMean(const std::vector<double>& vec);
-    double CalculateSTD(const std::vector<double>& vec);
-    double CalculateGLCMMean_i(const std::vector<std::vector<double>>& mat);
-    double CalculateGLCMMean_j(const std::vector<std::vector<double>>& mat);
-    double CalculateGLCMSTD_i(const std::vector<std::vector<double>>& mat);
-    double CalculateGLCMSTD_j(const std::vector<std::vector<double>>& mat);
-    Features CalculateQ(int i, int j);
-
-    void CalculateHX();
-    void CalculateHY();
-    void CalculateHXY();
-    void CalculateHXY1();
-    void CalculateHXY2();
+    void BuildSparse();         // sort the pairs of the bands into the non-zero cells
+    void ScatterSparseCounts(); // move the sparse counts into the dense matrices
+    void MirrorUpperTriangle(); // fill the lower triangle of the symmetric counts
+    const double* DenseP();     // full dense probability matrices, normalized from the counts on the first call
+
+    void CalculateMarginals(); // p_x, p_y, p_{x+y} and p_{x-y}
+    void SplitMarginals();     // copy the interleaved marginals into the vectors of the directions
+    void CalculateMarginalSums(MarginalSums& sums);
+    unsigned SelectJointSums(const FeatureSet& types); // JointSums::Which flags needed by the features
+    void CalculateJointSums(unsigned which, const double* mu_x, const double* mu_y, JointSums& sums);
+    // the features from the marginals and the joint sums the types need, as selected by SelectJointSums()
+    void CalculateFromSums(const FeatureSet& types, const JointSums& joint, FeatureResults& results);
+    void UpdateXLogXTable(); // extend the c log c table to the pair totals of the ROI
+
+    // fill the statistics cache on the first call after the ROI is processed
+    void UpdateMoments();      // mu, var and sigma, in O(Ng)
+    void UpdateEntropies();    // HX, HY, HXY1 and HXY2, in O(Ng)
+    void UpdateJointEntropy(); // HXY, in one traversal of the matrices
+    void SetJointEntropy(const double* HXY);
+    double CalculateMaximalCorrelation(int direction); // second largest eigenvalue of Q, from the dense p
 
     void ResetFactors();
 
@@ -146,29 +462,52 @@ private:
     std::string DirectionToString(const Direction& direction);
     std::string GetCurrentTime();
 
-    void CalculatePixelMean(const std::vector<double>& vec);
-    void CalculatePixelSTD(const std::vector<double>& vec);
+    void CalculatePixelStatistics(); // moments of the pixel value histogram
 
     int _Ng; // grey scale number, 256 (0 ~ 255) for example
 
+    int _num_threads;               // number of accumulation threads
+    std::vector<Partial> _partials; // accumulation buffers of the threads
+
+    const FeatureKernels* _kernels; // feature kernels selected for this CPU and Ng
+
+    Quantization _quantization;
+    double _bin_width;
+    double _lower_percentile;
+    double _upper_percentile;
+    double _window_level;
+    double _window_width;
+    std::vector<uchar> _levels; // gray level of every 8-bit pixel value
+    LevelMap _level_map;        // gray levels of the other depths
+
     int _R_H;  // normalization factor for 0 degree matrix
     int _R_V;  // normalization factor for 90 degree matrix
     int _R_LD; // normalization factor for 135 degree matrix
     int _R_RD; // normalization factor for 45 degree matrix
 
-    std::vector<std::vector<int>> _P_H;  // 0 degree matrix
-    std::vector<std::vector<int>> _P_V;  // 90 degree matrix
-    std::vector<std::vector<int>> _P_LD; // 135 degree matrix
-    std::vector<std::vector<int>> _P_RD; // 45 degree matrix
+    CooccurrenceMatrix<int> _P;    // 0, 90, 135 and 45 degree count matrices
+    CooccurrenceMatrix<double> _p; // 0, 90, 135 and 45 degree probability matrices, filled on demand by DenseP()
+    LevelRange _range;             // gray levels holding the non-zero cells of the matrices, the rest is skipped
 
-    std::vector<std::vector<double>> _p_H;  // 0 degree matrix
-    std::vector<std::vector<double>> _p_V;  // 90 degree matrix
-    std::vector<std::vector<double>> _p_LD; // 135 degree matrix
-    std::vector<std::vector<double>> _p_RD; // 45 degree matrix
+    bool _symmetric_mode;               // count the pairs of rectangles in the upper triangle
+    bool _symmetric;                    // the matrices hold their upper triangle only
+    bool _sparse;                       // the matrices are held in _sparse_P only
+    SparseCooccurrenceMatrix _sparse_P; // non-zero cells of small regions
+    std::vector<unsigned> _pairs;       // pairs of all the bands, sorted into _sparse_P
+    bool _normalized;                   // _p holds the full P / R
 
-    std::vector<double> _pixel_values; // pixel values in the region
+    std::vector<Span> _spans; // non-masked pixel spans of the polygon region
+
+    std::vector<long> _histogram; // pixel values in the region
     double _pixel_values_mean;
     double _pixel_values_STD;
+    double _pixel_values_skewness;
+    double _pixel_values_kurtosis;
+    double _pixel_values_energy;
+    double _pixel_values_entropy;
+
+    std::vector<double> _marginals; // marginals interleaved by direction, as returned by the kernels
+    std::vector<double> _xlogx;     // c log c of the counts c, kept over the ROIs
 
     // "p_x"
     std::vector<double> _px_H;
@@ -194,30 +533,10 @@ private:
     std::vector<double> _p_xny_LD;
     std::vector<double> _p_xny_RD;
 
-    double _HX_H;
-    double _HX_V;
-    double _HX_LD;
-    double _HX_RD;
-
-    double _HY_H;
-    double _HY_V;
-    double _HY_LD;
-    double _HY_RD;
-
-    double _HXY_H;
-    double _HXY_V;
-    double _HXY_LD;
-    double _HXY_RD;
-
-    double _HXY1_H;
-    double _HXY1_V;
-    double _HXY1_LD;
-    double _HXY1_RD;
-
-    double _HXY2_H;
-    double _HXY2_V;
-    double _HXY2_LD;
-    double _HXY2_RD;
+    MarginalStatistics _stats; // statistics cache of the ROI
+    bool _moments_ready;
+    bool _entropies_ready;
+    bool _joint_entropy_ready;
 };
 
 } // namespace glcm
@@ -0,0 +1,333 @@
+#include "TileIndexAnalysis.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace glcm {
+
+TileIndexAnalysis::TileIndexAnalysis(int Ng, int distance, int tile_size)
+    : _Ng(TextureAnalysis::ValidLevels(Ng)), _distance(distance), _tile_size(tile_size), _engine(_Ng) {
+    if (_tile_size < 1) {
+        std::cerr << "Invalid tile size assignment (>= 1)!\n";
+        _tile_size = 1;
+    }
+    _engine.CheckDistance(_distance);
+}
+
+void TileIndexAnalysis::SetNumThreads(int num_threads) {
+    _engine.SetNumThreads(num_threads);
+}
+
+void TileIndexAnalysis::SetQuantization(Quantization quantization) {
+    _engine.SetQuantization(quantization);
+}
+
+void TileIndexAnalysis::SetBinWidth(double bin_width) {
+    _engine.SetBinWidth(bin_width);
+}
+
+void TileIndexAnalysis::SetPercentiles(double lower, double upper) {
+    _engine.SetPercentiles(lower, upper);
+}
+
+void TileIndexAnalysis::SetWindow(double level, double width) {
+    _engine.SetWindow(level, width);
+}
+
+void TileIndexAnalysis::SetSymmetric(bool symmetric) {
+    _engine.SetSymmetric(symmetric);
+}
+
+void TileIndexAnalysis::Build(const cv::Mat& image) {
+    _image = cv::Mat();
+    _pyramid.clear();
+    _num_tile_rows = 0;
+    _num_tile_cols = 0;
+    if (image.type() != CV_8UC1) {
+        std::cerr << "Invalid image type (CV_8UC1)!\n";
+        return;
+    }
+    if (_distance < 1) {
+        return;
+    }
+    _image = image;
+
+    // the gray levels of the whole image, shared by all the rectangles
+    std::vector<long> histogram;
+    if (_engine.NeedsHistogram()) {
+        _engine.CountRectHistogram(image, histogram);
+    }
+    _engine.BuildLevels(histogram);
+
+    _num_tile_rows = (image.rows + _tile_size - 1) / _tile_size;
+    _num_tile_cols = (image.cols + _tile_size - 1) / _tile_size;
+    int num_tiles = _num_tile_rows * _num_tile_cols;
+    _pyramid.emplace_back(num_tiles);
+
+    // the tiles are taken in turn by the threads
+    int num_bands = std::max(1, std::min(_engine._num_threads, num_tiles));
+    std::vector<std::vector<unsigned>> keys(num_bands);
+    std::atomic<int> next_tile(0);
+    TextureAnalysis::RunBands(num_bands, [&](int band) {
+        for (int tile = next_tile++; tile < num_tiles; tile = next_tile++) {
+            BuildTile(tile / _num_tile_cols, tile % _num_tile_cols, keys[band], _pyramid[0][tile]);
+        }
+    });
+
+    // the levels of the quadtree, up to a single node
+    std::vector<std::vector<std::pair<unsigned, int>>> cells(num_bands);
+    for (int level = 1; (LevelRows(level - 1) > 1) || (LevelCols(level - 1) > 1); ++level) {
+        int num_nodes = LevelRows(level) * LevelCols(level);
+        _pyramid.emplace_back(num_nodes);
+        std::atomic<int> next_node(0);
+        TextureAnalysis::RunBands(std::min(num_bands, num_nodes), [&](int band) {
+            for (int node = next_node++; node < num_nodes; node = next_node++) {
+                MergeNode(level, node / LevelCols(level), node % LevelCols(level), cells[band], _pyramid[level][node]);
+            }
+        });
+    }
+}
+
+void TileIndexAnalysis::MergeNode(int level, int row, int col, std::vector<std::pair<unsigned, int>>& cells, TileSummary& summary) {
+    // the cells of the children, sorted and merged as those of a tile
+    cells.clear();
+    int histogram[256] = {0};
+    for (int k = 0; k < num_directions; ++k) {
+        summary.R[k] = 0;
+    }
+    for (int child_row = 2 * row; child_row < std::min(2 * row + 2, LevelRows(level - 1)); ++child_row) {
+        for (int child_col = 2 * col; child_col < std::min(2 * col + 2, LevelCols(level - 1)); ++child_col) {
+            const TileSummary& child = _pyramid[level - 1][child_row * LevelCols(level - 1) + child_col];
+            for (std::size_t k = 0; k < child.cells.size(); ++k) {
+                cells.push_back({child.cells[k], child.counts[k]});
+            }
+            for (std::size_t k = 0; k < child.values.size(); ++k) {
+                histogram[child.values[k]] += child.value_counts[k];
+            }
+            for (int k = 0; k < num_directions; ++k) {
+                summary.R[k] += child.R[k];
+            }
+        }
+    }
+
+    std::sort(cells.begin(), cells.end());
+    summary.cells.clear();
+    summary.counts.clear();
+    for (const auto& cell : cells) {
+        if (summary.cells.empty() || (summary.cells.back() != cell.first)) {
+            summary.cells.push_back(cell.first);
+            summary.counts.push_back(0);
+        }
+        summary.counts.back() += cell.second;
+    }
+
+    summary.values.clear();
+    summary.value_counts.clear();
+    for (int v = 0; v < 256; ++v) {
+        if (histogram[v] > 0) {
+            summary.values.push_back((uchar)v);
+            summary.value_counts.push_back(histogram[v]);
+        }
+    }
+}
+
+void TileIndexAnalysis::BuildTile(int tile_row, int tile_col, std::vector<unsigned>& keys, TileSummary& summary) {
+    // The pairs (m, n) - (m + dm, n + dn) with the offsets of AccumulateRectRows() starting in the tile, wherever they end, sorted
+    // and merged into the cells of the upper triangle
+    const uchar* level = _engine._levels.data();
+    int d = _distance;
+    int top = tile_row * _tile_size;
+    int bottom = std::min(top + _tile_size, _image.rows);
+    int left = tile_col * _tile_size;
+    int right = std::min(left + _tile_size, _image.cols);
+    auto key = [this](int a, int b, int direction) {
+        return (((unsigned)std::min(a, b) * _Ng + std::max(a, b)) << 2) | direction;
+    };
+
+    keys.clear();
+    int histogram[256] = {0};
+    for (int k = 0; k < num_directions; ++k) {
+        summary.R[k] = 0;
+    }
+    for (int m = top; m < bottom; ++m) {
+        const uchar* row = _image.ptr<uchar>(m);
+        const uchar* row_below = (m + d < _image.rows) ? _image.ptr<uchar>(m + d) : nullptr;
+        for (int n = left; n < right; ++n) {
+            ++histogram[row[n]];
+            int a = level[row[n]];
+            if (n + d < _image.cols) { // 0 degree
+                keys.push_back(key(a, level[row[n + d]], 0));
+                summary.R[0] += 2;
+            }
+            if (row_below == nullptr) {
+                continue;
+            }
+            keys.push_back(key(a, level[row_below[n]], 1)); // 90 degree
+            summary.R[1] += 2;
+            if (n + d < _image.cols) { // 135 degree
+                keys.push_back(key(a, level[row_below[n + d]], 2));
+                summary.R[2] += 2;
+            }
+            if (n - d >= 0) { // 45 degree
+                keys.push_back(key(a, level[row_below[n - d]], 3));
+                summary.R[3] += 2;
+            }
+        }
+    }
+
+    std::sort(keys.begin(), keys.end());
+    summary.cells.clear();
+    summary.counts.clear();
+    for (std::size_t k = 0; k < keys.size(); ++k) {
+        if (summary.cells.empty() || (summary.cells.back() != keys[k])) {
+            summary.cells.push_back(keys[k]);
+            summary.counts.push_back(0);
+        }
+        ++summary.counts.back();
+    }
+
+    summary.values.clear();
+    summary.value_counts.clear();
+    for (int v = 0; v < 256; ++v) {
+        if (histogram[v] > 0) {
+            summary.values.push_back((uchar)v);
+            summary.value_counts.push_back(histogram[v]);
+        }
+    }
+}
+
+void TileIndexAnalysis::ProcessRect(const cv::Rect& roi) {
+    _engine.ResetCache();
+    cv::Rect rect = roi & cv::Rect(0, 0, _image.cols, _image.rows);
+    if ((rect.width <= 0) || (rect.height <= 0)) {
+        std::cerr << "Invalid ROI assignment (inside the indexed image)!\n";
+        _engine.Normalization();
+        return;
+    }
+
+    // The inner tiles start at or below the top side and at least d right of the left side, and end at least d above the bottom
+    // side and left of the right side, so every pair starting in them ends inside the rectangle. On the bottom and right sides of the
+    // image the summaries hold no pair leaving it, so the tiles reach the side.
+    int d = _distance;
+    int bottom_limit = rect.y + rect.height - d;
+    int right_limit = rect.x + rect.width - d;
+    int tile_row_begin = (rect.y + _tile_size - 1) / _tile_size;
+    int tile_row_end = (rect.y + rect.height >= _image.rows) ? _num_tile_rows : std::max(bottom_limit, 0) / _tile_size;
+    int tile_col_begin = (rect.x + d + _tile_size - 1) / _tile_size;
+    int tile_col_end = (rect.x + rect.width >= _image.cols) ? _num_tile_cols : std::max(right_limit, 0) / _tile_size;
+    bool inner = (tile_row_begin < tile_row_end) && (tile_col_begin < tile_col_end);
+    int inner_top = inner ? tile_row_begin * _tile_size : rect.y;
+    int inner_bottom = inner ? std::min(tile_row_end * _tile_size, _image.rows) : rect.y;
+    int inner_left = inner ? tile_col_begin * _tile_size : rect.x;
+    int inner_right = inner ? std::min(tile_col_end * _tile_size, _image.cols) : rect.x;
+
+    _engine._symmetric = _engine._symmetric_mode;
+    _engine._sparse = false; // the summaries add their counts to the cells at once
+    _engine.AccumulateBands(1, [&](int, TextureAnalysis::Partial& partial) {
+        if (inner) {
+            AddNodes((int)_pyramid.size() - 1, 0, 0, cv::Range(tile_row_begin, tile_row_end), cv::Range(tile_col_begin, tile_col_end),
+                partial);
+        }
+
+        // the frame around the inner tiles
+        for (int m = rect.y; m < rect.y + rect.height; ++m) {
+            if ((m >= inner_top) && (m < inner_bottom)) {
+                CountSegment(rect, m, rect.x, inner_left, partial);
+                CountSegment(rect, m, inner_right, rect.x + rect.width, partial);
+            } else {
+                CountSegment(rect, m, rect.x, rect.x + rect.width, partial);
+            }
+        }
+
+        // every pixel of the rectangle is in the histogram, the pairs end inside the rectangle
+        const uchar* level = _engine._levels.data();
+        for (int v = 0; v < 256; ++v) {
+            if (partial.histogram[v] > 0) {
+                partial.TrackLevel(level[v]);
+            }
+        }
+    });
+
+    _engine.Normalization();
+}
+
+void TileIndexAnalysis::AddNodes(int level, int row, int col, const cv::Range& tile_rows, const cv::Range& tile_cols,
+    TextureAnalysis::Partial& partial) {
+    // the tiles of the node, clipped to the grid
+    int top = row << level;
+    int bottom = std::min((row + 1) << level, _num_tile_rows);
+    int left = col << level;
+    int right = std::min((col + 1) << level, _num_tile_cols);
+    if ((top >= tile_rows.end) || (bottom <= tile_rows.start) || (left >= tile_cols.end) || (right <= tile_cols.start)) {
+        return;
+    }
+    if ((top >= tile_rows.start) && (bottom <= tile_rows.end) && (left >= tile_cols.start) && (right <= tile_cols.end)) {
+        AddSummary(_pyramid[level][row * LevelCols(level) + col], partial);
+        return;
+    }
+    for (int child_row = 2 * row; child_row < std::min(2 * row + 2, LevelRows(level - 1)); ++child_row) {
+        for (int child_col = 2 * col; child_col < std::min(2 * col + 2, LevelCols(level - 1)); ++child_col) {
+            AddNodes(level - 1, child_row, child_col, tile_rows, tile_cols, partial);
+        }
+    }
+}
+
+void TileIndexAnalysis::CountSegment(const cv::Rect& roi, int m, int col_begin, int col_end, TextureAnalysis::Partial& partial) {
+    // As AccumulateRectRows() on the row m of the rectangle, for the pairs starting in [col_begin, col_end)
+    const uchar* level = _engine._levels.data();
+    int d = _distance;
+    int roi_right = roi.x + roi.width;
+    const uchar* row = _image.ptr<uchar>(m);
+
+    for (int n = col_begin; n < col_end; ++n) {
+        partial.CountPixel(row[n]);
+    }
+
+    // 0 degree: (m, n) - (m, n + d)
+    for (int n = col_begin; n < std::min(col_end, roi_right - d); ++n) {
+        partial.CountPairH(level[row[n]], level[row[n + d]]);
+    }
+
+    if (m + d >= roi.y + roi.height) {
+        return;
+    }
+    const uchar* row_below = _image.ptr<uchar>(m + d);
+
+    // 90 degree: (m, n) - (m + d, n)
+    for (int n = col_begin; n < col_end; ++n) {
+        partial.CountPairV(level[row[n]], level[row_below[n]]);
+    }
+
+    // 135 degree: (m, n) - (m + d, n + d)
+    for (int n = col_begin; n < std::min(col_end, roi_right - d); ++n) {
+        partial.CountPairLD(level[row[n]], level[row_below[n + d]]);
+    }
+
+    // 45 degree: (m, n) - (m + d, n - d)
+    for (int n = std::max(col_begin, roi.x + d); n < col_end; ++n) {
+        partial.CountPairRD(level[row[n]], level[row_below[n - d]]);
+    }
+}
+
+void TileIndexAnalysis::AddSummary(const TileSummary& summary, TextureAnalysis::Partial& partial) {
+    for (std::size_t k = 0; k < summary.cells.size(); ++k) {
+        unsigned cell = summary.cells[k] >> 2;
+        partial.CountPairs((int)(cell / _Ng), (int)(cell % _Ng), (int)(summary.cells[k] & 3), summary.counts[k]);
+    }
+    for (int k = 0; k < num_directions; ++k) {
+        partial.AddPairs(k, summary.R[k]);
+    }
+    for (std::size_t k = 0; k < summary.values.size(); ++k) {
+        partial.histogram[summary.values[k]] += summary.value_counts[k];
+    }
+}
+
+void TileIndexAnalysis::Calculate(const FeatureSet& types, FeatureResults& results) {
+    _engine.Calculate(types, results);
+}
+
+FeatureResults TileIndexAnalysis::Calculate(const FeatureSet& types) {
+    return _engine.Calculate(types);
+}
+
+} // namespace glcm
@@ -0,0 +1,82 @@
+#ifndef GLCM_TILE_INDEX_ANALYSIS_HPP_
+#define GLCM_TILE_INDEX_ANALYSIS_HPP_
+
+#include <utility>
+#include <vector>
+
+#include "TextureAnalysis.hpp"
+
+namespace glcm {
+
+// Index of an image for the matrices of many rectangles. Build() cuts the image into a grid of tiles and keeps, for every tile, the
+// counts of the pairs starting in it and the pixel values of it, then merges them into a quadtree: a node of the level k holds the
+// summary of a block of 2^k x 2^k tiles. A rectangle takes the tiles lying inside it far enough from its right, left and bottom sides
+// for all their pairs to end inside it, covered by the largest nodes fitting in them, which are O(perimeter / tile size), and counts
+// only the pixels of the frame left around them and their pairs ending inside the rectangle. A query costs O(perimeter x (tile size +
+// d)) pixels plus one pass over the distinct cells of every node, at most 4 min(tile size^2 4^k, Ng^2) for a node of the level k,
+// instead of O(area). Every level takes at most the memory of the tiles, less as the cells of the merged tiles repeat. The matrices
+// are those of ProcessRectImage() on the rectangle, with the gray levels of the whole image.
+class TileIndexAnalysis {
+public:
+    TileIndexAnalysis(int Ng, int distance, int tile_size = 32);
+    ~TileIndexAnalysis() = default;
+
+    // the settings of TextureAnalysis, applied by Build(); the gray levels are those of the whole image
+    void SetNumThreads(int num_threads); // number of threads building the index
+    void SetQuantization(Quantization quantization);
+    void SetBinWidth(double bin_width);
+    void SetPercentiles(double lower, double upper);
+    void SetWindow(double level, double width);
+    void SetSymmetric(bool symmetric);
+
+    // Index of a CV_8UC1 image. The pixels are read again by the queries, so the image data must outlive the index.
+    void Build(const cv::Mat& image);
+
+    // matrices of the rectangle of the indexed image, clipped to it, as ProcessRectImage(image(roi), distance)
+    void ProcessRect(const cv::Rect& roi);
+
+    void Calculate(const FeatureSet& types, FeatureResults& results); // features of the last rectangle, replacing the results
+    FeatureResults Calculate(const FeatureSet& types);
+
+    TextureAnalysis& Engine() { // holds the matrices of the last rectangle
+        return _engine;
+    }
+
+private:
+    // Counts of a tile or of a node, the pairs (i, j), i <= j, of a direction in "cells" as (i Ng + j) * 4 + direction
+    struct TileSummary {
+        std::vector<unsigned> cells;
+        std::vector<int> counts;
+        std::vector<uchar> values; // pixel values of the tile
+        std::vector<int> value_counts;
+        int R[num_directions];     // pairs of every direction, each in both orders
+    };
+
+    void BuildTile(int tile_row, int tile_col, std::vector<unsigned>& keys, TileSummary& summary);
+    // the node (row, col) of the level from the up to 4 nodes below it
+    void MergeNode(int level, int row, int col, std::vector<std::pair<unsigned, int>>& cells, TileSummary& summary);
+    // the summaries of the largest nodes below the node (row, col) of the level covering the tiles [tile_rows) x [tile_cols)
+    void AddNodes(int level, int row, int col, const cv::Range& tile_rows, const cv::Range& tile_cols, TextureAnalysis::Partial& partial);
+    int LevelRows(int level) const { // size of the grid of a level
+        return (_num_tile_rows + (1 << level) - 1) >> level;
+    }
+    int LevelCols(int level) const {
+        return (_num_tile_cols + (1 << level) - 1) >> level;
+    }
+    // the pixels [col_begin, col_end) of the row m and their pairs ending inside the rectangle
+    void CountSegment(const cv::Rect& roi, int m, int col_begin, int col_end, TextureAnalysis::Partial& partial);
+    void AddSummary(const TileSummary& summary, TextureAnalysis::Partial& partial);
+
+    int _Ng;
+    int _distance;
+    int _tile_size;
+    int _num_tile_rows = 0;
+    int _num_tile_cols = 0;
+    cv::Mat _image;                      // the indexed image
+    std::vector<std::vector<TileSummary>> _pyramid; // row by row over the grid of every level, the tiles at the level 0
+    TextureAnalysis _engine;             // holds the settings, the gray levels of the image and the matrices of the last rectangle
+};
+
+} // namespace glcm
+
+#endif // GLCM_TILE_INDEX_ANALYSIS_HPP_
@@ -0,0 +1,180 @@
+#include "TiledMapAnalysis.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace glcm {
+
+TiledMapAnalysis::TiledMapAnalysis(int Ng, int window_size, int distance, int stride)
+    : _Ng(TextureAnalysis::ValidLevels(Ng)),
+      _window_size(window_size),
+      _distance(distance),
+      _stride(stride),
+      _tile_size(256),
+      _engine(_Ng) {
+    if ((_window_size < 3) || (_window_size % 2 == 0)) {
+        std::cerr << "Invalid window size assignment (odd size >= 3)!\n";
+    }
+    if (_stride < 1) {
+        std::cerr << "Invalid stride assignment (>= 1)!\n";
+    }
+    _engine.CheckDistance(_distance);
+}
+
+void TiledMapAnalysis::SetNumThreads(int num_threads) {
+    _engine.SetNumThreads(num_threads);
+}
+
+void TiledMapAnalysis::SetQuantization(Quantization quantization) {
+    _engine.SetQuantization(quantization);
+}
+
+void TiledMapAnalysis::SetBinWidth(double bin_width) {
+    _engine.SetBinWidth(bin_width);
+}
+
+void TiledMapAnalysis::SetPercentiles(double lower, double upper) {
+    _engine.SetPercentiles(lower, upper);
+}
+
+void TiledMapAnalysis::SetWindow(double level, double width) {
+    _engine.SetWindow(level, width);
+}
+
+void TiledMapAnalysis::SetSymmetric(bool symmetric) {
+    _engine.SetSymmetric(symmetric);
+}
+
+void TiledMapAnalysis::SetTileSize(int tile_size) {
+    if (tile_size < 1) {
+        std::cerr << "Invalid tile size assignment (>= 1)!\n";
+        return;
+    }
+    _tile_size = tile_size;
+}
+
+cv::Size TiledMapAnalysis::MapSize(const cv::Size& image_size) const {
+    int stride = std::max(_stride, 1);
+    return cv::Size((image_size.width + stride - 1) / stride, (image_size.height + stride - 1) / stride);
+}
+
+int TiledMapAnalysis::Center(int sample, int size) const {
+    return std::min(sample * _stride + _stride / 2, size - 1);
+}
+
+void TiledMapAnalysis::Calculate(const cv::Mat& image, const FeatureSet& types, cv::Mat& maps) {
+    if (image.type() != CV_8UC1) {
+        std::cerr << "Invalid image type (CV_8UC1)!\n";
+        maps.release();
+        return;
+    }
+    if ((_window_size < 3) || (_window_size % 2 == 0) || (_distance < 1) || (_stride < 1)) {
+        maps.release();
+        return;
+    }
+
+    FeatureSet map_types = types;
+    for (Type type : {Type::Score, Type::Age}) {
+        if (map_types.Has(type)) {
+            std::cerr << "The feature maps leave out the score and the age!\n";
+            map_types.Remove(type);
+        }
+    }
+    int num_channels = 0;
+    for (int k = 0; k < num_types; ++k) {
+        _channels[k] = -1;
+    }
+    map_types.ForEach([&](Type type) {
+        _channels[static_cast<int>(type)] = num_channels;
+        num_channels += num_directions;
+    });
+    if ((num_channels == 0) || (num_channels > CV_CN_MAX)) {
+        std::cerr << "Invalid feature types (1 ~ " << CV_CN_MAX / num_directions << " types)!\n";
+        maps.release();
+        return;
+    }
+    cv::Size map_size = MapSize(image.size());
+    maps.create(map_size.height, map_size.width, CV_32FC(num_channels));
+
+    // the gray levels of the whole image, shared by the engines of the workers
+    std::vector<long> histogram;
+    if (_engine.NeedsHistogram()) {
+        _engine.CountRectHistogram(image, histogram);
+    }
+    _engine.BuildLevels(histogram);
+
+    // tiles of whole samples, taken in turn by the workers
+    int tile_samples = std::max(1, _tile_size / _stride);
+    int num_tile_rows = (map_size.height + tile_samples - 1) / tile_samples;
+    int num_tile_cols = (map_size.width + tile_samples - 1) / tile_samples;
+    int num_tiles = num_tile_rows * num_tile_cols;
+    int num_workers = std::max(1, std::min(_engine._num_threads, num_tiles));
+    while (_workers.size() < num_workers) {
+        _workers.push_back({TextureAnalysis(_Ng), FeatureResults()});
+    }
+    for (int k = 0; k < num_workers; ++k) {
+        _workers[k].engine._levels = _engine._levels;
+        _workers[k].engine.SetSymmetric(_engine._symmetric_mode);
+    }
+
+    std::atomic<int> next_tile(0);
+    TextureAnalysis::RunBands(num_workers, [&](int band) {
+        for (int tile = next_tile++; tile < num_tiles; tile = next_tile++) {
+            int tile_row = tile / num_tile_cols;
+            int tile_col = tile % num_tile_cols;
+            cv::Range sample_rows(tile_row * tile_samples, std::min((tile_row + 1) * tile_samples, map_size.height));
+            cv::Range sample_cols(tile_col * tile_samples, std::min((tile_col + 1) * tile_samples, map_size.width));
+            ProcessTile(image, map_types, sample_rows, sample_cols, _workers[band], maps);
+        }
+    });
+}
+
+void TiledMapAnalysis::ProcessTile(const cv::Mat& image, const FeatureSet& types, const cv::Range& sample_rows,
+    const cv::Range& sample_cols, Worker& worker, cv::Mat& maps) {
+    // the tile of the image holding the windows of its samples, overlapping its neighbours by half a window
+    int half = _window_size / 2;
+    int top = std::max(Center(sample_rows.start, image.rows) - half, 0);
+    int bottom = std::min(Center(sample_rows.end - 1, image.rows) + half + 1, image.rows);
+    int left = std::max(Center(sample_cols.start, image.cols) - half, 0);
+    int right = std::min(Center(sample_cols.end - 1, image.cols) + half + 1, image.cols);
+    cv::Mat tile = image(cv::Rect(left, top, right - left, bottom - top));
+
+    int num_channels = maps.channels();
+    for (int r = sample_rows.start; r < sample_rows.end; ++r) {
+        int center_row = Center(r, image.rows);
+        int row_begin = std::max(center_row - half, 0);
+        int row_end = std::min(center_row + half + 1, image.rows);
+        float* map_row = maps.ptr<float>(r);
+        for (int c = sample_cols.start; c < sample_cols.end; ++c) {
+            int center_col = Center(c, image.cols);
+            int col_begin = std::max(center_col - half, 0);
+            int col_end = std::min(center_col + half + 1, image.cols);
+            ProcessWindow(tile(cv::Rect(col_begin - left, row_begin - top, col_end - col_begin, row_end - row_begin)), types, worker);
+
+            float* pixel = map_row + (std::size_t)c * num_channels;
+            worker.results.ForEach([&](Type type, const Features& f) {
+                if (!types.Has(type)) {
+                    return; // set along with a selected type
+                }
+                float* values = pixel + _channels[static_cast<int>(type)];
+                values[0] = (float)f.H;
+                values[1] = (float)f.V;
+                values[2] = (float)f.LD;
+                values[3] = (float)f.RD;
+            });
+        }
+    }
+}
+
+void TiledMapAnalysis::ProcessWindow(const cv::Mat& window, const FeatureSet& types, Worker& worker) {
+    // ProcessRectImage() on a single band, with the gray levels of the image instead of those of the window
+    TextureAnalysis& engine = worker.engine;
+    engine.ResetCache();
+    engine._symmetric = engine._symmetric_mode;
+    engine._sparse = engine.UseSparse(2L * window.rows * window.cols);
+    engine.AccumulateBands(1, [&](int, auto& partial) { engine.AccumulateRect(window, _distance, 0, window.rows, partial); });
+    engine.Normalization();
+    engine.Calculate(types, worker.results);
+}
+
+} // namespace glcm
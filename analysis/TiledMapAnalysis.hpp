@@ -0,0 +1,63 @@
+#ifndef GLCM_TILED_MAP_ANALYSIS_HPP_
+#define GLCM_TILED_MAP_ANALYSIS_HPP_
+
+#include <vector>
+
+#include "TextureAnalysis.hpp"
+
+namespace glcm {
+
+// Feature maps of large images sampled every stride pixels: the sample (r, c) holds the features of the w x w window centered on the
+// pixel (r stride + stride / 2, c stride + stride / 2), clipped at the image borders, as ProcessRectImage() finds them for that
+// window with the gray levels of the whole image. The samples are split into tiles, each read from the tile of the image grown by
+// half a window, the border it shares with its neighbours. The workers take the tiles in turn, each with an engine of its own, and
+// write the samples straight into the maps. A sample costs O(w^2) counts, so the stride of a coarse heatmap cuts the work by
+// stride^2; for maps of every pixel, FeatureMapAnalysis updates the window incrementally instead.
+class TiledMapAnalysis {
+public:
+    TiledMapAnalysis(int Ng, int window_size, int distance, int stride); // odd window size of at least 3, stride of at least 1
+    ~TiledMapAnalysis() = default;
+
+    // the settings of TextureAnalysis; the gray levels are those of the whole image
+    void SetNumThreads(int num_threads); // number of workers, 0 for all hardware threads (default: 1)
+    void SetQuantization(Quantization quantization);
+    void SetBinWidth(double bin_width);
+    void SetPercentiles(double lower, double upper);
+    void SetWindow(double level, double width);
+    void SetSymmetric(bool symmetric);
+    void SetTileSize(int tile_size); // side of the tiles in image pixels, rounded to whole samples (default: 256)
+
+    // size of the maps of an image, ceil(rows / stride) x ceil(cols / stride)
+    cv::Size MapSize(const cv::Size& image_size) const;
+
+    // Maps of a CV_8UC1 image, as a CV_32FC(4 n) image of MapSize() for the n types, with the channels of FeatureMapAnalysis::Channel().
+    // The score and the age are not available. The maps are reallocated only when their size or number of channels changes, so the
+    // buffer of a previous call is filled in place, and released when the image, the settings or the types are invalid.
+    void Calculate(const cv::Mat& image, const FeatureSet& types, cv::Mat& maps);
+
+private:
+    // Buffers of a worker
+    struct Worker {
+        TextureAnalysis engine;
+        FeatureResults results;
+    };
+
+    // the samples [sample_rows) x [sample_cols) of a tile
+    void ProcessTile(const cv::Mat& image, const FeatureSet& types, const cv::Range& sample_rows, const cv::Range& sample_cols,
+        Worker& worker, cv::Mat& maps);
+    void ProcessWindow(const cv::Mat& window, const FeatureSet& types, Worker& worker); // the features of a window into the results
+    int Center(int sample, int size) const; // image pixel at the center of a sample along a side of the given size
+
+    int _Ng;
+    int _window_size;
+    int _distance;
+    int _stride;
+    int _tile_size;
+    TextureAnalysis _engine;      // holds the settings and the gray levels of the image
+    std::vector<Worker> _workers; // one per thread
+    int _channels[num_types];     // first channel of every type in the maps, -1 if not in them
+};
+
+} // namespace glcm
+
+#endif // GLCM_TILED_MAP_ANALYSIS_HPP_
@@ -0,0 +1,325 @@
+#include "VolumeAnalysis.hpp"
+
+#include <algorithm>
+#include <climits>
+
+namespace glcm {
+
+VolumeAnalysis::VolumeAnalysis(int Ng, const std::vector<Offset3D>& offsets) : OffsetEngines(Ng, Forwards(offsets)) {
+    for (const auto& offset : _offsets) {
+        _reach = std::max(_reach, offset.dz);
+    }
+}
+
+VolumeAnalysis::VolumeAnalysis(int Ng, int distance) : VolumeAnalysis(Ng, Directions(distance)) {}
+
+std::vector<Offset3D> VolumeAnalysis::Directions(int distance) {
+    if (distance < 1) {
+        std::cerr << "Invalid distance assignment (distance < 1)!\n";
+        return {};
+    }
+
+    int d = distance;
+    std::vector<Offset3D> offsets = {{0, 0, d}, {0, d, 0}, {0, d, d}, {0, d, -d}};
+    for (int dy : {-d, 0, d}) {
+        for (int dx : {-d, 0, d}) {
+            offsets.push_back({d, dy, dx});
+        }
+    }
+    return offsets;
+}
+
+std::vector<Offset3D> VolumeAnalysis::Forwards(const std::vector<Offset3D>& offsets) {
+    // the pairs are counted in both orders, so every offset is turned towards the next slices (rows, columns), which are the ones
+    // still to come while streaming
+    std::vector<Offset3D> forwards = offsets;
+    for (auto& offset : forwards) {
+        if ((offset.dz < 0) || ((offset.dz == 0) && ((offset.dy < 0) || ((offset.dy == 0) && (offset.dx < 0))))) {
+            offset = {-offset.dz, -offset.dy, -offset.dx};
+        }
+        if ((offset.dz == 0) && (offset.dy == 0) && (offset.dx == 0)) {
+            std::cerr << "Invalid offset assignment (0, 0, 0)!\n";
+        }
+    }
+    return forwards;
+}
+
+void VolumeAnalysis::ProcessVolume(const std::vector<cv::Mat>& slices, const std::vector<cv::Mat>& masks) {
+    if (_engines.empty()) {
+        return;
+    }
+    if (!masks.empty() && (masks.size() != slices.size())) {
+        std::cerr << "Invalid masks assignment (" << masks.size() << " masks for " << slices.size() << " slices)!\n";
+        return;
+    }
+    bool masked = !masks.empty();
+
+    // the histogram of the whole volume is at hand, so all the quantizations work as for the images
+    std::vector<long> histogram;
+    long num_voxels = 0;
+    if (_engines.front().NeedsHistogram()) {
+        histogram.assign(256, 0);
+    }
+    for (int z = 0; z < slices.size(); ++z) {
+        if (slices[z].type() != CV_8UC1) {
+            continue; // reported by Append()
+        }
+        for (int m = 0; m < slices[z].rows; ++m) {
+            const uchar* row = slices[z].ptr<uchar>(m);
+            const uchar* mask_row = masked && (masks[z].size() == slices[z].size()) ? masks[z].ptr<uchar>(m) : nullptr;
+            for (int n = 0; n < slices[z].cols; ++n) {
+                if (masked && (!mask_row || !mask_row[n])) {
+                    continue;
+                }
+                ++num_voxels;
+                if (!histogram.empty()) {
+                    ++histogram[row[n]];
+                }
+            }
+        }
+    }
+
+    Begin(histogram, (int)slices.size(), num_voxels, masked);
+    for (int z = 0; z < slices.size(); ++z) {
+        Append(slices[z], masked ? masks[z] : cv::Mat());
+    }
+    Flush(true);
+    Finish();
+}
+
+void VolumeAnalysis::ProcessVolume(const uchar* data, int depth, int rows, int cols, const uchar* mask) {
+    // the slices of the buffer are used in place
+    std::vector<cv::Mat> slices;
+    std::vector<cv::Mat> masks;
+    std::size_t slice_size = (std::size_t)rows * cols;
+    for (int z = 0; z < depth; ++z) {
+        slices.emplace_back(rows, cols, CV_8UC1, (void*)(data + z * slice_size));
+        if (mask) {
+            masks.emplace_back(rows, cols, CV_8UC1, (void*)(mask + z * slice_size));
+        }
+    }
+    ProcessVolume(slices, masks);
+}
+
+void VolumeAnalysis::BeginStream(bool masked, const std::vector<long>& histogram) {
+    if (_engines.empty()) {
+        return;
+    }
+    std::vector<long> levels_histogram = histogram;
+    if (_engines.front().NeedsHistogram() && (histogram.size() != 256)) {
+        std::cerr << "Invalid histogram assignment (the quantization needs the 256 bins of the volume)!\n";
+        levels_histogram.assign(256, 0); // the whole 0 ~ 255 range is rescaled
+    }
+    Begin(levels_histogram, 0, 0, masked);
+    _streaming = true;
+}
+
+void VolumeAnalysis::AddSlice(const cv::Mat& slice, const cv::Mat& mask) {
+    if (!_streaming) {
+        std::cerr << "Invalid slice (no stream begun)!\n";
+        return;
+    }
+    // the slices are copied, so the caller may reuse its buffers
+    if (Append(slice.clone(), mask.clone())) {
+        Flush(false);
+    }
+}
+
+void VolumeAnalysis::EndStream() {
+    if (!_streaming) {
+        std::cerr << "Invalid end of stream (no stream begun)!\n";
+        return;
+    }
+    Flush(true);
+    Finish();
+    _streaming = false;
+}
+
+void VolumeAnalysis::Begin(const std::vector<long>& histogram, int num_slices, long num_voxels, bool masked) {
+    _window.clear();
+    _window_begin = 0;
+    _size = cv::Size();
+    _depth = 0;
+    _next = 0;
+    _masked = masked;
+
+    // The slabs of the threads keep their buffers for the whole volume. A streamed volume has an unknown size, so it gets a
+    // buffer per thread and the dense matrices, and its slices are counted as soon as there is one for every thread.
+    TextureAnalysis& first = _engines.front();
+    _num_bands = (num_slices > 0) ? first.CountBands(num_slices, num_voxels) : first.CountBands(INT_MAX, LONG_MAX);
+    _batch = _num_bands;
+    for (auto& engine : _engines) {
+        engine.ResetCache();
+        engine.BuildLevels(histogram);
+        engine._symmetric = !masked && engine._symmetric_mode; // the masked voxels count both orders
+        engine._sparse = (num_slices > 0) && engine.UseSparse(2 * num_voxels);
+        engine.PreparePartials(_num_bands);
+        for (int band = 0; band < _num_bands; ++band) {
+            engine._partials[band].Reset(engine._Ng, engine._sparse, engine._symmetric);
+        }
+    }
+}
+
+bool VolumeAnalysis::Append(const cv::Mat& slice, const cv::Mat& mask) {
+    if (slice.type() != CV_8UC1) {
+        std::cerr << "Invalid slice " << _depth << " (the slices should be CV_8UC1)!\n";
+        return false;
+    }
+    if (_depth == 0) {
+        _size = slice.size();
+    } else if (slice.size() != _size) {
+        std::cerr << "Invalid slice " << _depth << " (the slices should have the same size)!\n";
+        return false;
+    }
+    if (_masked && ((mask.type() != CV_8UC1) || (mask.size() != _size))) {
+        std::cerr << "Invalid mask of slice " << _depth << " (the masks should be CV_8UC1 of the slice size)!\n";
+        return false;
+    }
+    if (!_masked && !mask.empty()) {
+        std::cerr << "Invalid mask of slice " << _depth << " (the volume is not masked)!\n";
+        return false;
+    }
+
+    _window.push_back({slice, mask});
+    ++_depth;
+    return true;
+}
+
+void VolumeAnalysis::Flush(bool last) {
+    // a slice is counted once the slices it is paired with have arrived, by the thread of its slab
+    int ready = last ? _depth : _depth - _reach;
+    if ((ready <= _next) || (!last && (ready - _next < _batch))) {
+        return;
+    }
+    int num_slices = ready - _next;
+    int num_bands = std::min(_num_bands, num_slices);
+    TextureAnalysis::RunBands(num_bands, [&](int band) {
+        int z_begin = _next + (int)((long)num_slices * band / num_bands);
+        int z_end = _next + (int)((long)num_slices * (band + 1) / num_bands);
+        for (int z = z_begin; z < z_end; ++z) {
+            if (_masked) {
+                AccumulateMaskedSlice(z, band);
+            } else {
+                AccumulateSlice(z, band);
+            }
+        }
+    });
+    _next = ready;
+
+    // the masked voxels also pair with the previous slices
+    while (_window_begin < _next - _reach) {
+        _window.pop_front();
+        ++_window_begin;
+    }
+}
+
+void VolumeAnalysis::Finish() {
+    for (auto& engine : _engines) {
+        engine.ReducePartials(_num_bands);
+        engine.Normalization();
+    }
+    _window.clear();
+}
+
+void VolumeAnalysis::AccumulateSlice(int z, int band) {
+    // as AccumulateRectOffsets: every pair (z, m, n) - (z + dz, m + dy, n + dx) is counted in both orders with the slice z
+    const cv::Mat& image = SliceAt(z).image;
+    for (int k = 0; k < _engines.size(); ++k) {
+        TextureAnalysis& engine = _engines[k];
+        TextureAnalysis::Partial& partial = engine._partials[band];
+        const uchar* level = engine._levels.data();
+
+        for (int m = 0; m < image.rows; ++m) {
+            const uchar* row = image.ptr<uchar>(m);
+            for (int n = 0; n < image.cols; ++n) {
+                partial.CountPixel(row[n]);
+            }
+            partial.TrackLevels(level, row, 0, image.cols);
+        }
+
+        for (int lane = 0; lane < num_directions; ++lane) {
+            const Offset3D& offset = _groups[k][lane];
+            if (((offset.dz == 0) && (offset.dy == 0) && (offset.dx == 0)) || (z + offset.dz >= _depth)) {
+                continue;
+            }
+            const cv::Mat& other = SliceAt(z + offset.dz).image;
+            int m_begin = std::max(0, -offset.dy);
+            int m_end = std::min(image.rows, image.rows - offset.dy);
+            int n_begin = std::max(0, -offset.dx);
+            int n_end = std::min(image.cols, image.cols - offset.dx);
+            if ((m_begin >= m_end) || (n_begin >= n_end)) {
+                continue;
+            }
+            for (int m = m_begin; m < m_end; ++m) {
+                const uchar* row = image.ptr<uchar>(m);
+                const uchar* row_other = other.ptr<uchar>(m + offset.dy);
+                for (int n = n_begin; n < n_end; ++n) {
+                    partial.CountPair(level[row[n]], level[row_other[n + offset.dx]], lane);
+                }
+                if (offset.dz > 0) { // the slice z + dz may belong to the next slab
+                    partial.TrackLevels(level, row_other, n_begin + offset.dx, n_end + offset.dx);
+                }
+            }
+            partial.AddPairs(lane, 2 * (m_end - m_begin) * (n_end - n_begin));
+        }
+    }
+}
+
+void VolumeAnalysis::AccumulateMaskedSlice(int z, int band) {
+    // as AccumulatePolygonOffsets: a pair is counted from its non-masked voxel towards both neighbors inside the volume
+    const Slice& slice = SliceAt(z);
+    const cv::Mat& image = slice.image;
+    for (int k = 0; k < _engines.size(); ++k) {
+        TextureAnalysis& engine = _engines[k];
+        TextureAnalysis::Partial& partial = engine._partials[band];
+        const uchar* level = engine._levels.data();
+
+        for (int m = 0; m < image.rows; ++m) {
+            const uchar* row = image.ptr<uchar>(m);
+            const uchar* mask_row = slice.mask.ptr<uchar>(m);
+            for (int n = 0; n < image.cols; ++n) {
+                if (mask_row[n]) {
+                    partial.CountPixel(row[n]);
+                    partial.TrackLevel(level[row[n]]);
+                }
+            }
+        }
+
+        for (int lane = 0; lane < num_directions; ++lane) {
+            const Offset3D& offset = _groups[k][lane];
+            if ((offset.dz == 0) && (offset.dy == 0) && (offset.dx == 0)) {
+                continue;
+            }
+            for (int sign : {1, -1}) {
+                int dz = sign * offset.dz;
+                int dy = sign * offset.dy;
+                int dx = sign * offset.dx;
+                if ((z + dz < 0) || (z + dz >= _depth)) {
+                    continue;
+                }
+                const cv::Mat& other = SliceAt(z + dz).image;
+                int m_begin = std::max(0, -dy);
+                int m_end = std::min(image.rows, image.rows - dy);
+                int n_begin = std::max(0, -dx);
+                int n_end = std::min(image.cols, image.cols - dx);
+                int num_pairs = 0;
+                for (int m = m_begin; m < m_end; ++m) {
+                    const uchar* row = image.ptr<uchar>(m);
+                    const uchar* mask_row = slice.mask.ptr<uchar>(m);
+                    const uchar* row_other = other.ptr<uchar>(m + dy);
+                    for (int n = n_begin; n < n_end; ++n) {
+                        if (mask_row[n]) {
+                            int j = level[row_other[n + dx]];
+                            partial.TrackLevel(j);
+                            partial.Count(level[row[n]], j, lane);
+                            ++num_pairs;
+                        }
+                    }
+                }
+                partial.AddPairs(lane, num_pairs);
+            }
+        }
+    }
+}
+
+} // namespace glcm
@@ -0,0 +1,82 @@
+#ifndef GLCM_VOLUME_ANALYSIS_HPP_
+#define GLCM_VOLUME_ANALYSIS_HPP_
+
+#include <deque>
+#include <vector>
+
+#include "OffsetSetAnalysis.hpp"
+
+namespace glcm {
+
+// Offset of the voxel pairs (z, m, n) - (z + dz, m + dy, n + dx), counted in both orders as Offset
+struct Offset3D {
+    int dz;
+    int dy;
+    int dx;
+};
+
+// Texture analysis of a volume given as a stack of slices. The co-occurrences are counted across the slices as well, for the 13
+// directions of Directions() or any set of 3-D offsets, which are taken four at a time as the directions of a TextureAnalysis
+// engine by OffsetEngines as in OffsetSetAnalysis. The slices are processed in slabs of consecutive slices by the threads.
+//
+// The volume can be given whole, or streamed one slice at a time between BeginStream() and EndStream(): only the slices still
+// paired with the coming ones are kept. Without masks every pair inside the volume is counted in both orders, as for the rectangle
+// images, and with masks the pairs of the non-masked voxels are counted towards both neighbors, as for the polygon images.
+class VolumeAnalysis : public OffsetEngines<Offset3D> {
+public:
+    VolumeAnalysis(int Ng, const std::vector<Offset3D>& offsets);
+    VolumeAnalysis(int Ng, int distance); // the 13 directions at the distance
+    ~VolumeAnalysis() = default;
+
+    // the 4 directions H, V, LD and RD in the slices, then the 9 directions towards the next slices
+    static std::vector<Offset3D> Directions(int distance);
+
+    // the whole volume, as CV_8UC1 slices of the same size or a depth x rows x cols buffer, with optional masks of the same layout
+    void ProcessVolume(const std::vector<cv::Mat>& slices, const std::vector<cv::Mat>& masks = {});
+    void ProcessVolume(const uchar* data, int depth, int rows, int cols, const uchar* mask = nullptr);
+
+    // Streamed volume. The min/max and percentile quantizations need the pixel value histogram (256 bins) of the whole volume up
+    // front; the masks are given for all the slices or none.
+    void BeginStream(bool masked = false, const std::vector<long>& histogram = {});
+    void AddSlice(const cv::Mat& slice, const cv::Mat& mask = cv::Mat());
+    void EndStream();
+
+    const std::vector<Offset3D>& Offsets() const { // normalized to point towards the next slices, rows and columns
+        return _offsets;
+    }
+
+private:
+    struct Slice {
+        cv::Mat image;
+        cv::Mat mask;
+    };
+
+    static std::vector<Offset3D> Forwards(const std::vector<Offset3D>& offsets); // the offsets of Offsets()
+    // reset the engines for a new volume, of num_slices slices and num_voxels voxels if known (else 0)
+    void Begin(const std::vector<long>& histogram, int num_slices, long num_voxels, bool masked);
+    bool Append(const cv::Mat& slice, const cv::Mat& mask); // add a slice to the window
+    void Flush(bool last);                                  // count the pairs of the slices having all their neighbors in the window
+    void Finish();                                          // reduce and normalize the matrices
+    void AccumulateSlice(int z, int band);
+    void AccumulateMaskedSlice(int z, int band);
+    const Slice& SliceAt(int z) const {
+        return _window[z - _window_begin];
+    }
+
+    int _reach = 0; // slices away from a slice read by its pairs
+
+    // state of the volume being processed
+    std::deque<Slice> _window; // the slices from _window_begin still paired with the slices to come
+    int _window_begin = 0;
+    cv::Size _size;            // size of the slices
+    int _depth = 0;            // number of slices received
+    int _next = 0;             // first slice whose pairs are not counted yet
+    int _num_bands = 0;        // accumulation buffers of every engine
+    int _batch = 1;            // number of slices counted together by the threads while streaming
+    bool _masked = false;      // the slices come with masks
+    bool _streaming = false;
+};
+
+} // namespace glcm
+
+#endif // GLCM_VOLUME_ANALYSIS_HPP_
@@ -15,6 +15,7 @@ cv::Mat drawing_image;  // drawing image
 cv::Mat original_image; // original image
 cv::Mat roi_image;      // ROI image
 cv::Mat mask_image;     // Mask is black and white where our ROI is
+cv::Rect mask_bounds;   // Bounding box of the polygon in the mask
 
 std::vector<cv::Point> vertices; // polygon points
 int image_width;                 // image width
@@ -22,7 +23,8 @@ int image_height;                // image height
 
 void Controller::Run(const std::string& filename, int d, int Ng) {
     glcm::TextureAnalysis texture_analysis(Ng);
-    std::map<glcm::Type, glcm::Features> results;
+    texture_analysis.SetNumThreads(0);
+    glcm::FeatureResults results;
 
     while (execution) {
         // Initialize the global variables
@@ -34,7 +36,10 @@ void Controller::Run(const std::string& filename, int d, int Ng) {
         finish_drawing = false;
 
         drawing_image = imread(filename, IMREAD_GRAYSCALE);
-        original_image = drawing_image.clone();
+        original_image = imread(filename, IMREAD_GRAYSCALE | IMREAD_ANYDEPTH);
+        if (original_image.depth() != CV_8U) {
+            texture_analysis.SetQuantization(glcm::Quantization::MinMax);
+        }
         image_width = drawing_image.cols;
         image_height = drawing_image.rows;
 
@@ -54,11 +59,10 @@ void Controller::Run(const std::string& filename, int d, int Ng) {
             break;
         }
 
-        texture_analysis.ProcessPolygonImage(original_image, mask_image, d);
+        texture_analysis.ProcessPolygonImage(original_image, mask_image, d, mask_bounds);
 
-        results.clear();
-        std::set<glcm::Type> features{glcm::Type::Mean, glcm::Type::Entropy, glcm::Type::Contrast};
-        results = texture_analysis.Calculate(features);
+        glcm::FeatureSet features{glcm::Type::Mean, glcm::Type::Entropy, glcm::Type::Contrast};
+        texture_analysis.Calculate(features, results);
         texture_analysis.Print(results);
 
         glcm::Viewer viewer(roi_image);
@@ -82,6 +86,7 @@ void Controller::MouseCallBackFunc(int event, int x, int y, int flags, void* use
 
         std::vector<std::vector<cv::Point>> points{vertices};
         cv::fillPoly(mask_image, points, Scalar(white_color));
+        mask_bounds = cv::boundingRect(vertices);
 
         // Copy the image to ROI with the mask_image with the white part (if value = 255)
         original_image.copyTo(roi_image, mask_image);
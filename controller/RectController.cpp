@@ -6,9 +6,14 @@ using namespace cv;
 namespace rect {
 
 void Controller::Run(const std::string& filename, int d, int Ng) {
-    cv::Mat image = imread(filename, IMREAD_GRAYSCALE);
+    cv::Mat image = imread(filename, IMREAD_GRAYSCALE | IMREAD_ANYDEPTH);
     glcm::TextureAnalysis texture_analysis(Ng);
-    std::map<glcm::Type, glcm::Features> results;
+    texture_analysis.SetNumThreads(0);
+    texture_analysis.SetSymmetric(true); // rectangles count every pair in both orders
+    if (image.depth() != CV_8U) {
+        texture_analysis.SetQuantization(glcm::Quantization::MinMax);
+    }
+    glcm::FeatureResults results;
 
     while (true) {
         bool from_center(false);
@@ -22,10 +27,9 @@ void Controller::Run(const std::string& filename, int d, int Ng) {
         cv::Mat image_crop = image(selected_roi);
         texture_analysis.ProcessRectImage(image_crop, d);
 
-        std::set<glcm::Type> features{glcm::Type::Mean, glcm::Type::Entropy, glcm::Type::Contrast};
+        glcm::FeatureSet features{glcm::Type::Mean, glcm::Type::Entropy, glcm::Type::Contrast};
 
-        results.clear();
-        results = texture_analysis.Calculate(features);
+        texture_analysis.Calculate(features, results);
         texture_analysis.Print(results);
 
         if (image_crop.cols > 0 && image_crop.rows > 0) {
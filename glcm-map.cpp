@@ -0,0 +1,67 @@
+#include <opencv2/opencv.hpp>
+
+#include "analysis/FeatureMapAnalysis.hpp"
+#include "analysis/TiledMapAnalysis.hpp"
+
+using namespace std;
+using namespace cv;
+
+const int Ng = 256;
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 5) {
+        cout << "Usage: ./glcm-map <file name> <distance> <window size> <stride>" << endl;
+        return 1;
+    }
+
+    // Set the image file name, the distance, the window size and the stride of the samples
+    string filename = argv[1];
+    int d = (argc >= 3) ? stoi(argv[2]) : 1;
+    int window_size = (argc >= 4) ? stoi(argv[3]) : 31;
+    int stride = (argc == 5) ? stoi(argv[4]) : 8;
+
+    // Read image
+    cv::Mat image = imread(filename, IMREAD_GRAYSCALE);
+    if (image.empty()) {
+        std::cerr << "Invalid image file!\n";
+        return 1;
+    }
+
+    // Initialize the tiled feature maps
+    glcm::TiledMapAnalysis map_analysis(Ng, window_size, d, stride);
+    map_analysis.SetNumThreads(0); // one worker per hardware thread
+    map_analysis.SetSymmetric(true);
+
+    // Calculate the maps, one feature vector every stride pixels
+    const std::vector<std::pair<glcm::Type, string>> names = {
+        {glcm::Type::Energy, "Energy"}, {glcm::Type::Contrast, "Contrast"}, {glcm::Type::Entropy, "Entropy"}};
+    glcm::FeatureSet features{glcm::Type::Energy, glcm::Type::Contrast, glcm::Type::Entropy};
+    cv::Mat maps;
+    map_analysis.Calculate(image, features, maps);
+    if (maps.empty()) { // the window size, the distance or the stride was rejected
+        cout << "Usage: ./glcm-map <file name> <distance> <window size: odd, >= 3> <stride: >= 1>" << endl;
+        return 1;
+    }
+
+    // Show and save the average over the directions of every feature as a heatmap of the image size
+    std::vector<cv::Mat> channels;
+    cv::split(maps, channels);
+    for (const auto& [type, name] : names) {
+        int channel = glcm::FeatureMapAnalysis::Channel(features, type, glcm::Direction::H);
+        cv::Mat average = (channels[channel] + channels[channel + 1] + channels[channel + 2] + channels[channel + 3]) / 4.0;
+        cv::Mat heatmap;
+        cv::patchNaNs(average, 0.0);
+        cv::normalize(average, heatmap, 0, 255, cv::NORM_MINMAX, CV_8U);
+        cv::resize(heatmap, heatmap, image.size(), 0, 0, cv::INTER_NEAREST);
+        cv::applyColorMap(heatmap, heatmap, cv::COLORMAP_JET);
+
+        cv::imshow(name, heatmap);
+        cv::imwrite("glcm-map-" + name + ".png", heatmap);
+    }
+    cv::waitKey(0);
+
+    // Destroy all windows
+    cv::destroyAllWindows();
+
+    return 0;
+}
@@ -19,13 +19,14 @@ cv::Mat drawing_image;  // drawing image
 cv::Mat original_image; // original image
 cv::Mat roi_image;      // ROI image
 cv::Mat mask_image;     // Mask is black and white where our ROI is
+cv::Rect mask_bounds;   // Bounding box of the polygon in the mask
 
 std::vector<cv::Point> vertices; // polygon points
 int img_width;                   // image width
 int img_height;                  // image height
 int d;                           // neighborhood distance
 
-std::map<glcm::Type, glcm::Features> results; // GLCM calculation results
+glcm::FeatureResults results; // GLCM calculation results
 
 void MouseCallBackFunc(int event, int x, int y, int flags, void* userdata);
 std::vector<std::pair<int, int>> GetMinMax(const std::vector<cv::Point>& vec);
@@ -49,6 +50,7 @@ int main(int argc, char* argv[]) {
 
     // Initialize the texture analysis
     glcm::TextureAnalysis texture_analysis(Ng);
+    texture_analysis.SetNumThreads(0);
 
     while (execution) {
         cout << "=================================================================================\n";
@@ -67,8 +69,11 @@ int main(int argc, char* argv[]) {
         img_width = drawing_image.cols;
         img_height = drawing_image.rows;
 
-        // Make a copy of the original image
-        original_image = drawing_image.clone();
+        // Read the original image again, at its own depth
+        original_image = imread(filename, IMREAD_GRAYSCALE | IMREAD_ANYDEPTH);
+        if (original_image.depth() != CV_8U) {
+            texture_analysis.SetQuantization(glcm::Quantization::MinMax);
+        }
 
         // Create a window
         cv::namedWindow("Original Image");
@@ -96,16 +101,13 @@ int main(int argc, char* argv[]) {
         // cout << "\noriginal_image = \n" << original_image << endl << endl; // this is the original drawing_image that we want
         // cout << "\nmask_image = \n" << mask_image << endl << endl;         // this is the original mask_image that we want
 
-        texture_analysis.ProcessPolygonImage(original_image, mask_image, d);
+        texture_analysis.ProcessPolygonImage(original_image, mask_image, d, mask_bounds);
 
         // Set feature types to calculate
-        std::set<glcm::Type> features{glcm::Type::Mean, glcm::Type::Entropy, glcm::Type::Contrast};
-
-        // Clear the calculation results
-        results.clear();
+        glcm::FeatureSet features{glcm::Type::Mean, glcm::Type::Entropy, glcm::Type::Contrast};
 
-        // Re-calculate the features
-        results = texture_analysis.Calculate(features);
+        // Re-calculate the features, replacing the previous results
+        texture_analysis.Calculate(features, results);
 
         // Print results
         texture_analysis.Print(results);
@@ -143,6 +145,7 @@ void MouseCallBackFunc(int event, int x, int y, int flags, void* userdata) {
         // Scalar(255) is white color (will show image in this part)
         std::vector<std::vector<cv::Point>> points{vertices};
         cv::fillPoly(mask_image, points, Scalar(white_color));
+        mask_bounds = cv::boundingRect(vertices);
 
         // Copy the image to ROI with the mask_image with the white part (if value = 255)
         original_image.copyTo(roi_image, mask_image);
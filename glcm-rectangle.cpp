@@ -10,7 +10,7 @@ using namespace cv;
 const int Ng = 256;
 int d; // neighborhood distance
 
-std::map<glcm::Type, glcm::Features> results; // GLCM calculation results
+glcm::FeatureResults results; // GLCM calculation results
 
 int main(int argc, char* argv[]) {
     if (argc < 2 || argc > 3) {
@@ -29,11 +29,16 @@ int main(int argc, char* argv[]) {
         d = 1;
     }
 
-    // Read image
-    cv::Mat image = imread(filename, IMREAD_GRAYSCALE);
+    // Read image at its own depth
+    cv::Mat image = imread(filename, IMREAD_GRAYSCALE | IMREAD_ANYDEPTH);
 
     // Initialize the texture analysis
     glcm::TextureAnalysis texture_analysis(Ng);
+    texture_analysis.SetNumThreads(0);
+    texture_analysis.SetSymmetric(true); // rectangles count every pair in both orders
+    if (image.depth() != CV_8U) {
+        texture_analysis.SetQuantization(glcm::Quantization::MinMax);
+    }
 
     // Select ROI repeatedly
     while (true) {
@@ -60,13 +65,10 @@ int main(int argc, char* argv[]) {
         texture_analysis.ProcessRectImage(image_crop, d);
 
         // Set feature types to calculate
-        std::set<glcm::Type> features{glcm::Type::Mean, glcm::Type::Entropy, glcm::Type::Contrast};
-
-        // Clear the calculation results
-        results.clear();
+        glcm::FeatureSet features{glcm::Type::Mean, glcm::Type::Entropy, glcm::Type::Contrast};
 
-        // Re-calculate the features
-        results = texture_analysis.Calculate(features);
+        // Re-calculate the features, replacing the previous results
+        texture_analysis.Calculate(features, results);
 
         // Print results
         texture_analysis.Print(results);
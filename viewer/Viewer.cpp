@@ -8,7 +8,14 @@
 
 namespace glcm {
 
-Viewer::Viewer(const cv::Mat& image) : _image(image) {}
+Viewer::Viewer(const cv::Mat& image) {
+    // the 16-bit and floating-point images are shown with their value range stretched over the 8 bits
+    if (image.depth() == CV_8U) {
+        _image = image;
+    } else {
+        cv::normalize(image, _image, 0, 255, cv::NORM_MINMAX, CV_8U);
+    }
+}
 
 void Viewer::Display() {
     cv::imshow("Image", _image);
@@ -73,7 +80,7 @@ void Viewer::DisplayPanel() {
     }
 }
 
-void Viewer::DisplayScorePanel(glcm::TextureAnalysis* glcm_texture_analysis, std::map<Type, Features>& glcm_features) {
+void Viewer::DisplayScorePanel(glcm::TextureAnalysis* glcm_texture_analysis, FeatureResults& glcm_features) {
     cv::Mat frame = _image.clone();
     int age = 40;
     int panel_width = 180;
@@ -103,11 +110,12 @@ void Viewer::DisplayScorePanel(glcm::TextureAnalysis* glcm_texture_analysis, std
         if (glcm_texture_analysis) {
             glcm_texture_analysis->CalculateScore(age, glcm_features);
         }
+        const FeatureResults& features = glcm_features; // reading does not mark the types as calculated
 
-        cvui::printf(canvas, items_x + 5, pad * 10.0, font_scale, font_color, "Intensity: %.4f", glcm_features.at(Type::Mean).Avg());
-        cvui::printf(canvas, items_x + 5, pad * 12.0, font_scale, font_color, "Entropy: %.4f", glcm_features.at(Type::Entropy).Avg());
-        cvui::printf(canvas, items_x + 5, pad * 14.0, font_scale, font_color, "Contrast: %.4f", glcm_features.at(Type::Contrast).Avg());
-        cvui::printf(canvas, items_x + 5, pad * 16.0, font_scale, font_color, "Score: %.1f", glcm_features.at(Type::Score).Avg());
+        cvui::printf(canvas, items_x + 5, pad * 10.0, font_scale, font_color, "Intensity: %.4f", features[Type::Mean].Avg());
+        cvui::printf(canvas, items_x + 5, pad * 12.0, font_scale, font_color, "Entropy: %.4f", features[Type::Entropy].Avg());
+        cvui::printf(canvas, items_x + 5, pad * 14.0, font_scale, font_color, "Contrast: %.4f", features[Type::Contrast].Avg());
+        cvui::printf(canvas, items_x + 5, pad * 16.0, font_scale, font_color, "Score: %.1f", features[Type::Score].Avg());
 
         cvui::update();
 
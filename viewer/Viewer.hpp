@@ -15,7 +15,7 @@ public:
 
     void Display();
     void DisplayPanel();
-    void DisplayScorePanel(TextureAnalysis* glcm_texture_analysis, std::map<Type, Features>& glcm_features);
+    void DisplayScorePanel(TextureAnalysis* glcm_texture_analysis, FeatureResults& glcm_features);
 
 private:
     cv::Mat _image;